@@ -0,0 +1,131 @@
+#include "agents.h"
+
+static const int HeadingX[4] = { 1, 0, -1, 0 };
+static const int HeadingY[4] = { 0, 1, 0, -1 };
+
+// Below this many agents per thread, waking the pool costs more than it saves
+static const size_t MinAgentsPerThread = 4096;
+
+Agents::Agents(std::shared_ptr<Maze> maze) :
+	maze(maze),
+	speed(4.0f),
+	threads(1),
+	agentTicksPerSecond(0)
+{}
+
+size_t Agents::Count() {
+	return x.size();
+}
+
+void Agents::Spawn(int count, unsigned int seed) {
+	mt19937 random(seed);
+
+	size_t first = Count();
+	size_t total = first + count;
+
+	x.reserve(total);
+	y.reserve(total);
+	xVelocity.reserve(total);
+	yVelocity.reserve(total);
+	targetX.reserve(total);
+	targetY.reserve(total);
+	heading.reserve(total);
+
+	for (int i = 0; i < count; i++) {
+		int cX = 0;
+		int cY = 0;
+		for (int tries = 0; tries < 64; tries++) {
+			int pX = random() % maze->width;
+			int pY = random() % maze->height;
+			if (maze->CellCheck(pX, pY, Maze::PathMask)) {
+				cX = pX;
+				cY = pY;
+				break;
+			}
+		}
+
+		// The target is the current cell, so the first Step picks a direction
+		x.push_back(cX + 0.5f);
+		y.push_back(cY + 0.5f);
+		xVelocity.push_back(0);
+		yVelocity.push_back(0);
+		targetX.push_back(cX);
+		targetY.push_back(cY);
+		heading.push_back(random() % 4);
+	}
+}
+
+void Agents::Clear() {
+	x.clear();
+	y.clear();
+	xVelocity.clear();
+	yVelocity.clear();
+	targetX.clear();
+	targetY.clear();
+	heading.clear();
+}
+
+void Agents::Decide(size_t begin, size_t end) {
+	for (size_t i = begin; i < end; i++) {
+		float centreX = targetX[i] + 0.5f;
+		float centreY = targetY[i] + 0.5f;
+
+		// Still on the way to the target centre
+		if ((centreX - x[i]) * xVelocity[i] + (centreY - y[i]) * yVelocity[i] > 0) continue;
+
+		x[i] = centreX;
+		y[i] = centreY;
+
+		// Right turn first, then straight, left and finally back
+		static const int Turns[4] = { 1, 0, 3, 2 };
+		int h = heading[i];
+		for (int k = 0; k < 4; k++) {
+			int candidate = (heading[i] + Turns[k]) % 4;
+			if (maze->CellCheck(targetX[i] + HeadingX[candidate], targetY[i] + HeadingY[candidate], Maze::PathMask)) {
+				h = candidate;
+				break;
+			}
+		}
+
+		if (maze->CellCheck(targetX[i] + HeadingX[h], targetY[i] + HeadingY[h], Maze::PathMask)) {
+			heading[i] = h;
+			targetX[i] += HeadingX[h];
+			targetY[i] += HeadingY[h];
+			xVelocity[i] = speed * HeadingX[h];
+			yVelocity[i] = speed * HeadingY[h];
+		}
+		else {
+			// Walled in (e.g. the board is still being generated), wait in place
+			xVelocity[i] = 0;
+			yVelocity[i] = 0;
+		}
+	}
+}
+
+void Agents::Integrate(size_t begin, size_t end, float dt) {
+	float* px = x.data();
+	float* py = y.data();
+	const float* vx = xVelocity.data();
+	const float* vy = yVelocity.data();
+
+	// Branch-free and contiguous, so the compiler can vectorize it
+	for (size_t i = begin; i < end; i++) {
+		px[i] += vx[i] * dt;
+		py[i] += vy[i] * dt;
+	}
+}
+
+void Agents::Step(double dt) {
+	auto t1 = chrono::steady_clock::now();
+
+	size_t count = Count();
+	size_t workers = max((size_t)1, min((size_t)max(threads, 1), count / MinAgentsPerThread));
+
+	pool.Run(count, (int)workers, [this, dt](size_t, size_t begin, size_t end) {
+		Decide(begin, end);
+		Integrate(begin, end, (float)dt);
+	});
+
+	double elapsed = chrono::duration<double>(chrono::steady_clock::now() - t1).count();
+	if (elapsed > 0) agentTicksPerSecond = count / elapsed;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "core.h"
+#include "maze.h"
+#include "workers.h"
+
+/*
+Autonomous players sharing one maze, kept as structure-of-arrays so the integration
+pass runs over contiguous floats. Every agent walks cell centre to cell centre and
+picks its next cell with the right-hand wall-following rule
+*/
+class Agents {
+public:
+	Agents(std::shared_ptr<Maze> maze);
+
+	std::shared_ptr<Maze> maze;
+
+	// Cells per second
+	float speed;
+	// Threads used by Step, counting the calling thread. 1 steps on the calling thread alone
+	int threads;
+	// Measured by the last Step call
+	double agentTicksPerSecond;
+
+	vector<float> x;
+	vector<float> y;
+	vector<float> xVelocity;
+	vector<float> yVelocity;
+	vector<int> targetX;
+	vector<int> targetY;
+	// 0: +x, 1: +y, 2: -x, 3: -y
+	vector<BYTE> heading;
+
+	size_t Count();
+	void Spawn(int count, unsigned int seed);
+	void Clear();
+	void Step(double dt);
+private:
+	WorkerPool pool;
+
+	void Decide(size_t begin, size_t end);
+	void Integrate(size_t begin, size_t end, float dt);
+};
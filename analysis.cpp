@@ -0,0 +1,121 @@
+#include "analysis.h"
+#include "maze.h"
+#include "workers.h"
+
+/*
+Frontiers smaller than this are expanded on the calling thread: a few thousand cells are about
+what it takes to outweigh waking the pool for a level. Carved mazes are corridors whose frontiers
+stay in the hundreds even at 4000x4000, so on them only the neighbour count runs in parallel and
+the BFS pays off on boards with open areas
+*/
+static const size_t ParallelFrontier = 1 << 12;
+
+struct Sweep {
+	long long eccentricity;
+	unsigned int farthest;
+	long long targetDistance;
+};
+
+Sweep Bfs(WorkerPool& pool, const BYTE* board, int width, int height, unsigned int source, unsigned int target, int threads) {
+	size_t cells = (size_t)width * height;
+	size_t words = (cells + 63) / 64;
+	unique_ptr<atomic<unsigned long long>[]> visited(new atomic<unsigned long long>[words]());
+
+	auto claim = [&visited](unsigned int cell) {
+		unsigned long long bit = 1ull << (cell & 63);
+		return !(visited[cell >> 6].fetch_or(bit, memory_order_relaxed) & bit);
+	};
+
+	auto expand = [&](const unsigned int* frontier, size_t begin, size_t end, vector<unsigned int>& next) {
+		for (size_t i = begin; i < end; i++) {
+			unsigned int cell = frontier[i];
+			unsigned int cY = cell / width;
+			unsigned int cX = cell - cY * width;
+
+			if (cX > 0 && (board[cell - 1] & Maze::PathMask) && claim(cell - 1)) next.push_back(cell - 1);
+			if (cX + 1 < (unsigned int)width && (board[cell + 1] & Maze::PathMask) && claim(cell + 1)) next.push_back(cell + 1);
+			if (cY > 0 && (board[cell - width] & Maze::PathMask) && claim(cell - width)) next.push_back(cell - width);
+			if (cY + 1 < (unsigned int)height && (board[cell + width] & Maze::PathMask) && claim(cell + width)) next.push_back(cell + width);
+		}
+	};
+
+	Sweep sweep{ 0, source, -1 };
+
+	vector<unsigned int> frontier;
+	vector<unsigned int> next;
+	vector<vector<unsigned int>> local(max(threads, 1));
+
+	claim(source);
+	frontier.push_back(source);
+	if (source == target) sweep.targetDistance = 0;
+
+	for (long long level = 1; ; level++) {
+		next.clear();
+
+		if (frontier.size() < ParallelFrontier || threads <= 1) {
+			expand(frontier.data(), 0, frontier.size(), next);
+		}
+		else {
+			pool.Run(frontier.size(), threads, [&](size_t w, size_t begin, size_t end) {
+				local[w].clear();
+				expand(frontier.data(), begin, end, local[w]);
+			});
+			for (vector<unsigned int>& part : local) next.insert(next.end(), part.begin(), part.end());
+		}
+
+		if (next.empty()) break;
+
+		if (sweep.targetDistance < 0 && (visited[target >> 6].load(memory_order_relaxed) & (1ull << (target & 63)))) sweep.targetDistance = level;
+		sweep.eccentricity = level;
+		sweep.farthest = next[0];
+
+		swap(frontier, next);
+	}
+
+	return sweep;
+}
+
+MazeStats AnalyzeBoard(const BYTE* board, int width, int height, int threads) {
+	MazeStats stats{};
+	stats.cells = (long long)width * height;
+	stats.solutionLength = -1;
+
+	if (!board || width < 1 || height < 1) return stats;
+
+	// One pool for the whole analysis, the BFS may fork it once per level
+	WorkerPool pool;
+
+	// Neighbour counts, one stripe of rows per worker
+	vector<MazeStats> partial(max(threads, 1), MazeStats{});
+	pool.Run(height, threads, [&](size_t w, size_t begin, size_t end) {
+		MazeStats& out = partial[w];
+		for (size_t i = begin; i < end; i++) {
+			const BYTE* row = board + i * width;
+			for (int j = 0; j < width; j++) {
+				if (!(row[j] & Maze::PathMask)) continue;
+
+				int around = (j > 0 && (row[j - 1] & Maze::PathMask)) + (j < width - 1 && (row[j + 1] & Maze::PathMask)) +
+					(i > 0 && (row[j - width] & Maze::PathMask)) + (i < (size_t)height - 1 && (row[j + width] & Maze::PathMask));
+
+				out.pathCells++;
+				out.junctions[around]++;
+			}
+		}
+	});
+	for (MazeStats& part : partial) {
+		stats.pathCells += part.pathCells;
+		for (int k = 0; k < 5; k++) stats.junctions[k] += part.junctions[k];
+	}
+	stats.deadEnds = stats.junctions[1];
+
+	if (!(board[0] & Maze::PathMask)) return stats;
+
+	unsigned int exit = (unsigned int)(stats.cells - 1);
+	Sweep first = Bfs(pool, board, width, height, 0, exit, threads);
+	Sweep second = Bfs(pool, board, width, height, first.farthest, exit, threads);
+
+	stats.solutionLength = first.targetDistance;
+	stats.diameter = second.eccentricity;
+
+	return stats;
+}
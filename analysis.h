@@ -0,0 +1,23 @@
+#pragma once
+
+#include "core.h"
+
+struct MazeStats {
+	long long cells;
+	long long pathCells;
+	// Path cells with exactly one path neighbour
+	long long deadEnds;
+	// Path cells by their number of path neighbours, 0 to 4
+	long long junctions[5];
+	// Steps from (0, 0) to (width - 1, height - 1), -1 if the exit can't be reached
+	long long solutionLength;
+	// Longest shortest path, found with two BFS sweeps (exact while the maze is a tree, a lower bound once loops appear)
+	long long diameter;
+};
+
+/*
+Headless analysis of a board laid out like Maze's (row-major, Maze::PathMask marks open cells).
+The BFS runs level by level over a flat frontier with a bit-packed visited set, and both the
+neighbour counting and large frontiers are split across `threads` workers
+*/
+MazeStats AnalyzeBoard(const BYTE* board, int width, int height, int threads);
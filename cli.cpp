@@ -0,0 +1,1087 @@
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#endif
+
+#include "core.h"
+#include "maze.h"
+#include "agents.h"
+#include "analysis.h"
+#include "replay.h"
+#include "fov.h"
+#include "raytable.h"
+#include "scene.h"
+#include "stream.h"
+
+/*
+Headless front end to the maze core, for batch runs and load tests without a window:
+	maze-cli generate [--size WxH] [--count K] [--seed S] [--iterations N] [--algorithm backtracker]
+	                  [--threads T] [--format bin|pbm|ascii] [--out DIR]
+	maze-cli analyze [--threads T] FILE|DIR...
+	maze-cli simulate [--size WxH] [--seed S] [--agents N] [--threads T] [--ticks N]
+	maze-cli bench [--size WxH] [--seed S] [--iterations N] [--count K] [--rays N] [--ticks N]
+	               [--range R] [--columns C] [--stride N]
+	maze-cli replay FILE
+	maze-cli stream [--size WxH] [--seed S] [--iterations N] [--ticks N] [--count CLIENTS]
+	maze-cli verify [--size WxH] [--seed S] [--iterations N] [--cases N] [--rays N] [--columns C] [--stride N]
+	                [--baseline FILE] [--save-baseline FILE] [--tolerance PERCENT]
+Every command prints one JSON object to stdout. Errors go to stderr with exit code 1,
+bad arguments with exit code 2
+*/
+
+struct Options {
+	int width;
+	int height;
+	int count;
+	unsigned int seed;
+	int iterations;
+	int threads;
+	int agents;
+	int ticks;
+	long long rays;
+	int range;
+	int columns;
+	int stride;
+	int cases;
+	double tolerance;
+	string algorithm;
+	string format;
+	string out;
+	string baseline;
+	string saveBaseline;
+	vector<string> files;
+
+	Options() :
+		width(100),
+		height(100),
+		count(1),
+		seed(1),
+		iterations(5),
+		threads(max((int)thread::hardware_concurrency(), 1)),
+		agents(100000),
+		ticks(1000),
+		rays(1000000),
+		range(5),
+		columns(800),
+		stride(8),
+		cases(200),
+		tolerance(20),
+		algorithm("backtracker"),
+		format("bin")
+	{}
+};
+
+typedef chrono::steady_clock Clock;
+
+// Every operator new in the process is counted, so bench sees all a generation allocates: the board,
+// the stacks, their growth and the generation thread's own state
+static atomic<long long> heapAllocations(0);
+
+void* operator new(size_t size) {
+	heapAllocations++;
+	if (void* block = malloc(size ? size : 1)) return block;
+	throw bad_alloc();
+}
+
+void* operator new(size_t size, const nothrow_t&) noexcept {
+	heapAllocations++;
+	return malloc(size ? size : 1);
+}
+
+void operator delete(void* block) noexcept {
+	free(block);
+}
+
+void operator delete(void* block, const nothrow_t&) noexcept {
+	free(block);
+}
+
+// The remaining forms forward to the ones above, so every allocation and release pairs up
+void* operator new[](size_t size) {
+	return operator new(size);
+}
+
+void* operator new[](size_t size, const nothrow_t& tag) noexcept {
+	return operator new(size, tag);
+}
+
+void operator delete[](void* block) noexcept {
+	free(block);
+}
+
+void operator delete[](void* block, const nothrow_t&) noexcept {
+	free(block);
+}
+
+void operator delete(void* block, size_t) noexcept {
+	free(block);
+}
+
+void operator delete[](void* block, size_t) noexcept {
+	free(block);
+}
+
+double Seconds(Clock::time_point since) {
+	return chrono::duration<double>(Clock::now() - since).count();
+}
+
+string Quote(const string& text) {
+	string quoted = "\"";
+	for (char c : text) {
+		if (c == '"' || c == '\\') quoted += '\\';
+		quoted += c;
+	}
+	return quoted + "\"";
+}
+
+void PrintStats(const MazeStats& stats) {
+	printf("\"pathCells\": %lld, \"deadEnds\": %lld, \"junctions\": [%lld, %lld, %lld, %lld, %lld], \"solutionLength\": %lld, \"diameter\": %lld",
+		stats.pathCells, stats.deadEnds, stats.junctions[0], stats.junctions[1], stats.junctions[2], stats.junctions[3], stats.junctions[4],
+		stats.solutionLength, stats.diameter);
+}
+
+bool ParseOptions(int argc, char** argv, Options& options) {
+	for (int i = 2; i < argc; i++) {
+		string arg = argv[i];
+		if (arg.compare(0, 2, "--") != 0) {
+			options.files.push_back(arg);
+			continue;
+		}
+		if (i + 1 >= argc) {
+			fprintf(stderr, "%s needs a value\n", arg.c_str());
+			return false;
+		}
+
+		const char* value = argv[++i];
+		if (arg == "--size") {
+			int matched = sscanf(value, "%dx%d", &options.width, &options.height);
+			if (matched == 1) options.height = options.width;
+			else if (matched != 2) options.width = 0;
+		}
+		else if (arg == "--count") options.count = atoi(value);
+		else if (arg == "--seed") options.seed = (unsigned int)strtoul(value, nullptr, 10);
+		else if (arg == "--iterations") options.iterations = atoi(value);
+		else if (arg == "--threads") options.threads = atoi(value);
+		else if (arg == "--agents") options.agents = atoi(value);
+		else if (arg == "--ticks") options.ticks = atoi(value);
+		else if (arg == "--rays") options.rays = atoll(value);
+		else if (arg == "--range") options.range = atoi(value);
+		else if (arg == "--columns") options.columns = atoi(value);
+		else if (arg == "--stride") options.stride = atoi(value);
+		else if (arg == "--cases") options.cases = atoi(value);
+		else if (arg == "--tolerance") options.tolerance = atof(value);
+		else if (arg == "--baseline") options.baseline = value;
+		else if (arg == "--save-baseline") options.saveBaseline = value;
+		else if (arg == "--algorithm") options.algorithm = value;
+		else if (arg == "--format") options.format = value;
+		else if (arg == "--out") options.out = value;
+		else {
+			fprintf(stderr, "unknown option %s\n", arg.c_str());
+			return false;
+		}
+	}
+
+	// Generation needs a start cell and an exit cell apart from each other
+	if (options.width < 2 || options.height < 2) {
+		fprintf(stderr, "--size must be at least 2x2\n");
+		return false;
+	}
+	if (options.count < 1 || options.threads < 1 || options.agents < 0 || options.ticks < 1 || options.rays < 1 || options.columns < 1 || options.stride < 1 || options.cases < 1
+		|| options.iterations < 0 || options.range < 0 || options.tolerance < 0) {
+		fprintf(stderr, "--count, --threads, --ticks, --rays, --columns, --stride and --cases must be positive, --agents, --iterations, --range and --tolerance not negative\n");
+		return false;
+	}
+
+	return true;
+}
+
+// Plain PBM (P4): one bit per cell, walls black
+bool SavePBM(Maze& maze, const string& path) {
+	ofstream file(path, ios::binary | ios::trunc);
+	if (!file) return false;
+
+	file << "P4\n" << maze.width << " " << maze.height << "\n";
+
+	vector<BYTE> row((maze.width + 7) / 8);
+	for (int i = 0; i < maze.height; i++) {
+		fill(row.begin(), row.end(), 0);
+		for (int j = 0; j < maze.width; j++) {
+			if (!maze.CellCheck(j, i, Maze::PathMask)) row[j / 8] |= 0x80 >> (j % 8);
+		}
+		file.write((const char*)row.data(), row.size());
+	}
+
+	return (bool)file;
+}
+
+// One character per cell: '#' wall, '.' path, 'o' on the path from the start to the exit
+bool SaveText(Maze& maze, const string& path) {
+	ofstream file(path, ios::trunc);
+	if (!file) return false;
+
+	string row(maze.width, ' ');
+	for (int i = 0; i < maze.height; i++) {
+		for (int j = 0; j < maze.width; j++) {
+			row[j] = !maze.CellCheck(j, i, Maze::PathMask) ? '#' : maze.CellCheck(j, i, Maze::TruePathMask) ? 'o' : '.';
+		}
+		file << row << "\n";
+	}
+
+	return (bool)file;
+}
+
+int Generate(const Options& options) {
+	// The recursive backtracker in Maze::Carve is the only generator so far
+	if (options.algorithm != "backtracker") {
+		fprintf(stderr, "unknown algorithm %s\n", options.algorithm.c_str());
+		return 2;
+	}
+
+	const char* extension = options.format == "bin" ? ".mzb" : options.format == "pbm" ? ".pbm" : options.format == "ascii" ? ".txt" : nullptr;
+	if (!extension) {
+		fprintf(stderr, "unknown format %s\n", options.format.c_str());
+		return 2;
+	}
+
+	struct Result {
+		unsigned int seed;
+		double generationTime;
+		bool generationFailed;
+		double analysisTime;
+		MazeStats stats;
+		string path;
+		bool saved;
+	};
+	vector<Result> results(options.count);
+
+	// Each worker keeps one Maze, so its board and generation stacks are reused from the second maze on
+	atomic<int> next(0);
+	auto t1 = Clock::now();
+	vector<thread> pool;
+	for (int w = 0; w < min(options.threads, options.count); w++) {
+		pool.push_back(thread([&options, &results, &next, extension] {
+			Maze maze;
+			maze.width = options.width;
+			maze.height = options.height;
+			maze.iterations = options.iterations;
+
+			for (int i; (i = next++) < options.count;) {
+				Result& result = results[i];
+				result.seed = options.seed + i;
+
+				maze.Generate(result.seed);
+				maze.Wait();
+				result.generationTime = maze.generationTime;
+				result.generationFailed = maze.generationFailed;
+
+				result.saved = true;
+				if (!options.out.empty()) {
+					result.path = options.out + "/maze-" + to_string(result.seed) + extension;
+					if (options.format == "bin") result.saved = maze.Save(result.path);
+					else if (options.format == "pbm") result.saved = SavePBM(maze, result.path);
+					else result.saved = SaveText(maze, result.path);
+				}
+
+				auto t2 = Clock::now();
+				result.stats = AnalyzeBoard(maze.GetBoard(), maze.width, maze.height, 1);
+				result.analysisTime = Seconds(t2);
+			}
+		}));
+	}
+	for (thread& worker : pool) worker.join();
+	double elapsed = Seconds(t1);
+
+	bool saved = true;
+	int failures = 0;
+	printf("{\"command\": \"generate\", \"algorithm\": %s, \"width\": %d, \"height\": %d, \"iterations\": %d, \"count\": %d, \"threads\": %d, ",
+		Quote(options.algorithm).c_str(), options.width, options.height, options.iterations, options.count, options.threads);
+	printf("\"seconds\": %.6f, \"mazesPerSecond\": %.3f, \"mazes\": [", elapsed, options.count / elapsed);
+	for (int i = 0; i < options.count; i++) {
+		const Result& result = results[i];
+		printf("%s\n\t{\"seed\": %u, \"generationSeconds\": %.6f, \"outOfMemory\": %s, \"analysisSeconds\": %.6f, ",
+			i ? "," : "", result.seed, result.generationTime, result.generationFailed ? "true" : "false", result.analysisTime);
+		if (!result.path.empty()) printf("\"file\": %s, \"saved\": %s, ", Quote(result.path).c_str(), result.saved ? "true" : "false");
+		PrintStats(result.stats);
+		printf("}");
+		saved = saved && result.saved;
+		failures += result.generationFailed;
+	}
+	printf("\n]}\n");
+
+	if (failures) {
+		fprintf(stderr, "%d mazes ran out of memory while generating\n", failures);
+		return 1;
+	}
+	if (!saved) {
+		fprintf(stderr, "some mazes could not be saved to %s\n", options.out.c_str());
+		return 1;
+	}
+	return 0;
+}
+
+// Appends the board files (*.mzb) in directory, sorted, false if it isn't a directory
+bool ListBoards(const string& directory, vector<string>& files) {
+	vector<string> names;
+#ifdef _WIN32
+	DWORD attributes = GetFileAttributesA(directory.c_str());
+	if (attributes == INVALID_FILE_ATTRIBUTES || !(attributes & FILE_ATTRIBUTE_DIRECTORY)) return false;
+
+	WIN32_FIND_DATAA entry;
+	HANDLE find = FindFirstFileA((directory + "\\*.mzb").c_str(), &entry);
+	if (find != INVALID_HANDLE_VALUE) {
+		do names.push_back(entry.cFileName);
+		while (FindNextFileA(find, &entry));
+		FindClose(find);
+	}
+#else
+	DIR* dir = opendir(directory.c_str());
+	if (!dir) return false;
+
+	while (dirent* entry = readdir(dir)) {
+		string name = entry->d_name;
+		if (name.size() > 4 && name.compare(name.size() - 4, 4, ".mzb") == 0) names.push_back(name);
+	}
+	closedir(dir);
+#endif
+
+	sort(names.begin(), names.end());
+	for (const string& name : names) files.push_back(directory + "/" + name);
+	return true;
+}
+
+int Analyze(const Options& options) {
+	if (options.files.empty()) {
+		fprintf(stderr, "analyze needs at least one board file or directory\n");
+		return 2;
+	}
+
+	vector<string> files;
+	for (const string& path : options.files) {
+		if (!ListBoards(path, files)) files.push_back(path);
+	}
+	if (files.empty()) {
+		fprintf(stderr, "no board files found\n");
+		return 1;
+	}
+
+	struct Result {
+		bool loaded;
+		int width;
+		int height;
+		unsigned int seed;
+		int iterations;
+		double analysisTime;
+		MazeStats stats;
+	};
+	vector<Result> results(files.size());
+
+	// Whole boards go to the workers first, threads left over split the analysis of each board
+	int workers = min(options.threads, (int)files.size());
+	int threadsPerBoard = max(options.threads / workers, 1);
+
+	atomic<size_t> next(0);
+	auto t1 = Clock::now();
+	vector<thread> pool;
+	for (int w = 0; w < workers; w++) {
+		pool.push_back(thread([&files, &results, &next, threadsPerBoard] {
+			Maze maze;
+			for (size_t i; (i = next++) < files.size();) {
+				Result& result = results[i];
+				result.loaded = maze.Load(files[i]);
+				if (!result.loaded) continue;
+
+				auto t2 = Clock::now();
+				result.stats = AnalyzeBoard(maze.GetBoard(), maze.width, maze.height, threadsPerBoard);
+				result.analysisTime = Seconds(t2);
+				result.width = maze.width;
+				result.height = maze.height;
+				result.seed = maze.seed;
+				result.iterations = maze.iterations;
+			}
+		}));
+	}
+	for (thread& worker : pool) worker.join();
+	double elapsed = Seconds(t1);
+
+	bool loaded = true;
+	printf("{\"command\": \"analyze\", \"threads\": %d, \"workers\": %d, \"threadsPerBoard\": %d, \"seconds\": %.6f, \"boardsPerSecond\": %.3f, \"boards\": [",
+		options.threads, workers, threadsPerBoard, elapsed, files.size() / elapsed);
+	for (size_t i = 0; i < files.size(); i++) {
+		const Result& result = results[i];
+		printf("%s\n\t{\"file\": %s, ", i ? "," : "", Quote(files[i]).c_str());
+		if (!result.loaded) {
+			printf("\"loaded\": false}");
+			loaded = false;
+			continue;
+		}
+
+		printf("\"width\": %d, \"height\": %d, \"seed\": %u, \"iterations\": %d, \"analysisSeconds\": %.6f, ",
+			result.width, result.height, result.seed, result.iterations, result.analysisTime);
+		PrintStats(result.stats);
+		printf("}");
+	}
+	printf("\n]}\n");
+
+	return loaded ? 0 : 1;
+}
+
+int Simulate(const Options& options) {
+	std::shared_ptr<Maze> maze(new Maze());
+	maze->width = options.width;
+	maze->height = options.height;
+	maze->iterations = options.iterations;
+	maze->Generate(options.seed);
+	maze->Wait();
+
+	Agents agents(maze);
+	agents.threads = options.threads;
+	agents.Spawn(options.agents, options.seed);
+
+	const double step = 1.0 / Maze::TickRate;
+	auto t1 = Clock::now();
+	for (int i = 0; i < options.ticks; i++) agents.Step(step);
+	double elapsed = Seconds(t1);
+
+	printf("{\"command\": \"simulate\", \"width\": %d, \"height\": %d, \"agents\": %zu, \"threads\": %d, \"ticks\": %d, \"seconds\": %.6f, \"agentTicksPerSecond\": %.0f}\n",
+		maze->width, maze->height, agents.Count(), options.threads, options.ticks, elapsed, agents.Count() * (double)options.ticks / elapsed);
+
+	return 0;
+}
+
+vector<pair<int, int>> OpenCells(Maze& maze) {
+	vector<pair<int, int>> open;
+	for (int i = 0; i < maze.height; i++) {
+		for (int j = 0; j < maze.width; j++) {
+			if (maze.CellCheck(j, i, Maze::PathMask)) open.push_back(make_pair(j, i));
+		}
+	}
+	return open;
+}
+
+// CastRay calls per second from random points of open cells in random directions
+double RayThroughput(Maze& maze, const vector<pair<int, int>>& open, long long rays, unsigned int seed, double& meanDistance) {
+	mt19937 random(seed);
+	uniform_real_distribution<double> unit(0, 1);
+
+	double distanceSum = 0;
+	auto t1 = Clock::now();
+	for (long long i = 0; i < rays; i++) {
+		const pair<int, int>& cell = open[random() % open.size()];
+		double angle = 2 * PI * unit(random);
+		distanceSum += maze.CastRay(cell.first + unit(random), cell.second + unit(random), cos(angle), sin(angle));
+	}
+	double elapsed = Seconds(t1);
+
+	meanDistance = distanceSum / rays;
+	return rays / elapsed;
+}
+
+// Ticks per second of PlayerStep<T> walking the maze with input that changes every quarter second
+template <typename T> double BenchPhysics(Maze& maze, int ticks, unsigned int seed) {
+	mt19937 random(seed);
+	PlayerState<T> player;
+	PlayerInitialize<T>(player, (T)0.5, (T)0.5, (T)0);
+	PlayerInput input = {};
+
+	auto t1 = Clock::now();
+	for (int i = 0; i < ticks; i++) {
+		if (i % (Maze::TickRate / 4) == 0) {
+			unsigned int bits = random();
+			input = { (bits & 1) != 0, (bits & 2) != 0, (bits & 4) != 0, (bits & 8) != 0 };
+		}
+		PlayerStep(player, input, (T)(1.0 / Maze::TickRate), maze);
+	}
+	double elapsed = Seconds(t1);
+
+	// Keep the final state observable so the loop can't be dropped
+	if (player.x != player.x) fprintf(stderr, "physics diverged\n");
+	return ticks / elapsed;
+}
+
+template <typename To, typename From> void CopyPlayer(PlayerState<To>& to, const PlayerState<From>& from) {
+	to.x = (To)from.x;
+	to.y = (To)from.y;
+	to.xVelocity = (To)from.xVelocity;
+	to.yVelocity = (To)from.yVelocity;
+	to.direction = (To)from.direction;
+	to.angularVelocity = (To)from.angularVelocity;
+	to.headingX = (To)from.headingX;
+	to.headingY = (To)from.headingY;
+}
+
+/*
+Steps PlayerStep<float> and PlayerStep<double> side by side on the same input, the one BenchPhysics
+uses, and returns the largest distance in cells between them. A wall stop is a threshold: rounding
+can stop one player a tick before the other. Such a tick counts as a split and the float player
+restarts from the double one, so the drift measured is that of the integration between collisions
+*/
+double PhysicsDrift(Maze& maze, int ticks, unsigned int seed, long long& splits) {
+	mt19937 random(seed);
+	PlayerState<double> reference;
+	PlayerState<float> player;
+	PlayerInitialize<double>(reference, 0.5, 0.5, 0.0);
+	PlayerInitialize<float>(player, 0.5f, 0.5f, 0.0f);
+	PlayerInput input = {};
+
+	double drift = 0;
+	for (int i = 0; i < ticks; i++) {
+		if (i % (Maze::TickRate / 4) == 0) {
+			unsigned int bits = random();
+			input = { (bits & 1) != 0, (bits & 2) != 0, (bits & 4) != 0, (bits & 8) != 0 };
+		}
+		PlayerStep(reference, input, 1.0 / Maze::TickRate, maze);
+		PlayerStep(player, input, (float)(1.0 / Maze::TickRate), maze);
+
+		if ((player.xVelocity == 0) != (reference.xVelocity == 0) || (player.yVelocity == 0) != (reference.yVelocity == 0)) {
+			splits++;
+			CopyPlayer(player, reference);
+		}
+		else drift = max(drift, hypot(player.x - reference.x, player.y - reference.y));
+	}
+	return drift;
+}
+
+int Bench(const Options& options) {
+	Maze maze;
+	maze.width = options.width;
+	maze.height = options.height;
+	maze.iterations = options.iterations;
+
+	// Generation, the first run allocates the board and stacks, the rest reuse them
+	double generationTotal = 0;
+	double generationBest = 1e300;
+	long long firstAllocations = 0;
+	long long laterAllocations = 0;
+	int failures = 0;
+	for (int i = 0; i < options.count; i++) {
+		long long before = heapAllocations;
+		maze.Generate(options.seed);
+		maze.Wait();
+		long long allocations = heapAllocations - before;
+		generationTotal += maze.generationTime;
+		generationBest = min(generationBest, maze.generationTime);
+		if (i == 0) firstAllocations = allocations;
+		else laterAllocations += allocations;
+		failures += maze.generationFailed;
+	}
+
+	vector<pair<int, int>> open = OpenCells(maze);
+	double meanDistance = 0;
+	double raysPerSecond = RayThroughput(maze, open, options.rays, options.seed, meanDistance);
+
+	mt19937 random(options.seed);
+	uniform_real_distribution<double> unit(0, 1);
+	auto t1 = Clock::now();
+
+	// Field of view from random open cells: shadowcasting against the ray fan mode 1 used to draw
+	const int views = 10000;
+	FieldOfView visibility;
+	long long visibleCells = 0;
+	t1 = Clock::now();
+	for (int i = 0; i < views; i++) {
+		const pair<int, int>& cell = open[random() % open.size()];
+		visibility.Compute(maze, cell.first, cell.second, options.range);
+		visibleCells += visibility.visible.size();
+	}
+	double shadowcastTime = Seconds(t1);
+
+	RayTable fan;
+	fan.Update(options.columns, PI / 2);
+	double fanDistanceSum = 0;
+	t1 = Clock::now();
+	for (int i = 0; i < views; i++) {
+		const pair<int, int>& cell = open[random() % open.size()];
+		double angle = 2 * PI * unit(random);
+		double forwardX = cos(angle);
+		double forwardY = sin(angle);
+		for (int j = 0; j < fan.columns; j++) {
+			double xComponent = forwardX * fan.xComponent[j] - forwardY * fan.yComponent[j];
+			double yComponent = forwardY * fan.xComponent[j] + forwardX * fan.yComponent[j];
+			fanDistanceSum += maze.CastRay(cell.first + 0.5, cell.second + 0.5, xComponent, yComponent);
+		}
+	}
+	double fanTime = Seconds(t1);
+	if (fanDistanceSum < 0) fprintf(stderr, "negative ray distance\n");
+
+	// The same column sweep with per-column cos and sin, as before the ray table, and with the table's camera basis
+	struct View {
+		double x;
+		double y;
+		double angle;
+	};
+	vector<View> sweepViews(views);
+	for (View& view : sweepViews) {
+		const pair<int, int>& cell = open[random() % open.size()];
+		view.x = cell.first + unit(random);
+		view.y = cell.second + unit(random);
+		view.angle = 2 * PI * unit(random);
+	}
+	double sweepSums[2] = { 0, 0 };
+	t1 = Clock::now();
+	for (const View& view : sweepViews) {
+		for (int j = 0; j < fan.columns; j++) {
+			double offset = -fan.fieldOfView / 2 + fan.fieldOfView * j / fan.columns;
+			sweepSums[0] += maze.CastRay(view.x, view.y, cos(view.angle + offset), sin(view.angle + offset)) * cos(offset);
+		}
+	}
+	double trigSweepTime = Seconds(t1);
+	t1 = Clock::now();
+	for (const View& view : sweepViews) {
+		double forwardX = cos(view.angle);
+		double forwardY = sin(view.angle);
+		for (int j = 0; j < fan.columns; j++) {
+			double xComponent = forwardX * fan.xComponent[j] - forwardY * fan.yComponent[j];
+			double yComponent = forwardY * fan.xComponent[j] + forwardX * fan.yComponent[j];
+			sweepSums[1] += maze.CastRay(view.x, view.y, xComponent, yComponent) * fan.correction[j];
+		}
+	}
+	double tableSweepTime = Seconds(t1);
+
+	// Mode 2 columns: a ray per column against adaptive sampling every stride-th column, from the same views
+	vector<RayHit> full;
+	vector<RayHit> adaptive;
+	long long adaptiveRays = 0;
+	long long mismatches = 0;
+	double distanceError = 0;
+	double wallError = 0;
+	double fullTime = 0;
+	double adaptiveTime = 0;
+	for (int i = 0; i < views; i++) {
+		const pair<int, int>& cell = open[random() % open.size()];
+		double x = cell.first + unit(random);
+		double y = cell.second + unit(random);
+		double angle = 2 * PI * unit(random);
+
+		t1 = Clock::now();
+		fan.Cast(maze, x, y, cos(angle), sin(angle), 1, full);
+		fullTime += Seconds(t1);
+		t1 = Clock::now();
+		adaptiveRays += fan.Cast(maze, x, y, cos(angle), sin(angle), options.stride, adaptive);
+		adaptiveTime += Seconds(t1);
+
+		for (int j = 0; j < fan.columns; j++) {
+			if (full[j].cellX != adaptive[j].cellX || full[j].cellY != adaptive[j].cellY || full[j].side != adaptive[j].side) mismatches++;
+			distanceError = max(distanceError, fabs(full[j].distance - adaptive[j].distance) / full[j].distance);
+			wallError = max(wallError, fabs(full[j].wallX - adaptive[j].wallX));
+		}
+	}
+
+	// Mode 2 frames at 1920 x 1080, floor, ceiling and textured walls, with a ray per column and with stride
+	const int frames = 100;
+	RayTable screen;
+	screen.Update(1920, PI / 2);
+	Scene scene;
+	vector<uint32_t> pixels;
+	double sceneTime[2] = { 0, 0 };
+	for (int i = 0; i < frames; i++) {
+		const pair<int, int>& cell = open[random() % open.size()];
+		double x = cell.first + unit(random);
+		double y = cell.second + unit(random);
+		double angle = 2 * PI * unit(random);
+
+		for (int k = 0; k < 2; k++) {
+			scene.rayStride = k ? options.stride : 1;
+			t1 = Clock::now();
+			scene.Render(maze, screen, 1080, x, y, cos(angle), sin(angle), pixels);
+			sceneTime[k] += Seconds(t1);
+		}
+	}
+
+	double doubleTicks = BenchPhysics<double>(maze, options.ticks, options.seed);
+	double floatTicks = BenchPhysics<float>(maze, options.ticks, options.seed);
+
+	printf("{\"command\": \"bench\", \"width\": %d, \"height\": %d, \"iterations\": %d, \"seed\": %u,\n", maze.width, maze.height, maze.iterations, options.seed);
+	printf("\t\"generation\": {\"runs\": %d, \"meanSeconds\": %.6f, \"bestSeconds\": %.6f, \"firstAllocations\": %lld, \"laterAllocations\": %lld, \"outOfMemory\": %d},\n",
+		options.count, generationTotal / options.count, generationBest, firstAllocations, laterAllocations, failures);
+	printf("\t\"raycast\": {\"rays\": %lld, \"seconds\": %.6f, \"raysPerSecond\": %.0f, \"meanDistance\": %.6f},\n",
+		options.rays, options.rays / raysPerSecond, raysPerSecond, meanDistance);
+	printf("\t\"fieldOfView\": {\"views\": %d, \"range\": %d, \"meanVisibleCells\": %.2f, \"shadowcastMicroseconds\": %.3f, \"rayFanColumns\": %d, \"rayFanMicroseconds\": %.3f},\n",
+		views, options.range, visibleCells / (double)views, shadowcastTime / views * 1e6, options.columns, fanTime / views * 1e6);
+	printf("\t\"rayTable\": {\"views\": %d, \"columns\": %d, \"trigMicroseconds\": %.3f, \"tableMicroseconds\": %.3f, \"speedup\": %.2f, \"distanceSumDifference\": %.3g},\n",
+		views, options.columns, trigSweepTime / views * 1e6, tableSweepTime / views * 1e6, trigSweepTime / tableSweepTime, fabs(sweepSums[0] - sweepSums[1]) / sweepSums[1]);
+	printf("\t\"columns\": {\"views\": %d, \"columns\": %d, \"stride\": %d, \"adaptiveRaysPerFrame\": %.1f, \"rayReduction\": %.2f, \"fullMicroseconds\": %.3f, \"adaptiveMicroseconds\": %.3f, \"mismatchedColumns\": %lld, \"maxDistanceError\": %.3g, \"maxWallError\": %.3g},\n",
+		views, options.columns, options.stride, adaptiveRays / (double)views, options.columns * (double)views / adaptiveRays, fullTime / views * 1e6, adaptiveTime / views * 1e6, mismatches, distanceError, wallError);
+	printf("\t\"scene\": {\"frames\": %d, \"width\": %d, \"height\": %d, \"stride\": %d, \"fullFramesPerSecond\": %.1f, \"adaptiveFramesPerSecond\": %.1f},\n",
+		frames, screen.columns, 1080, options.stride, frames / sceneTime[0], frames / sceneTime[1]);
+	printf("\t\"physics\": {\"ticks\": %d, \"doubleTicksPerSecond\": %.0f, \"floatTicksPerSecond\": %.0f}\n}\n",
+		options.ticks, doubleTicks, floatTicks);
+
+	return 0;
+}
+
+/*
+Loopback stream: a server publishes a player wandering on random keys, plus one cell edit per
+second, to count clients in the same process. Checks that every client ends with the server's state
+*/
+int Stream(const Options& options) {
+	Maze maze;
+	maze.width = options.width;
+	maze.height = options.height;
+	maze.iterations = options.iterations;
+	maze.Generate(options.seed);
+	maze.Wait();
+
+	StreamServer server;
+	if (!server.Open(0)) {
+		fprintf(stderr, "could not listen on a loopback port\n");
+		return 1;
+	}
+
+	vector<unique_ptr<StreamClient>> clients;
+	for (int i = 0; i < options.count; i++) {
+		clients.push_back(unique_ptr<StreamClient>(new StreamClient()));
+		if (!clients.back()->Connect("127.0.0.1", server.port)) {
+			fprintf(stderr, "could not connect to port %d\n", server.port);
+			return 1;
+		}
+	}
+
+	mt19937 random(options.seed);
+	const double step = 1.0 / Maze::TickRate;
+	bool connected = true;
+	auto t1 = Clock::now();
+	for (int tick = 1; tick <= options.ticks; tick++) {
+		if (tick % (Maze::TickRate / 4) == 0) SetKeyState(&maze, random() & 0x0F);
+		if (tick % Maze::TickRate == 0) {
+			int cellX = random() % maze.width;
+			int cellY = random() % maze.height;
+			if (maze.CellCheck(cellX, cellY, Maze::TruePathMask)) maze.CellRemove(cellX, cellY, Maze::TruePathMask);
+			else maze.CellAssign(cellX, cellY, Maze::TruePathMask);
+		}
+		maze.PlayerUpdate(step);
+
+		server.Publish(maze, tick);
+		for (unique_ptr<StreamClient>& client : clients) connected = client->Poll() && connected;
+	}
+	double elapsed = Seconds(t1);
+
+	// Let the last messages arrive, then compare what the clients rebuilt with the maze
+	const BYTE* board = maze.GetBoard();
+	auto Matches = [&](const StreamDecoder& state) {
+		if (!state.valid || state.width != maze.width || state.height != maze.height) return false;
+		for (size_t i = 0; i < state.board.size(); i++) {
+			if (state.board[i] != (board[i] & StreamFormat::CellMask)) return false;
+		}
+		const double tolerance = 0.5 / StreamFormat::PositionScale;
+		return fabs(state.playerX - maze.player.x) <= tolerance && fabs(state.playerY - maze.player.y) <= tolerance;
+	};
+
+	int matching = 0;
+	for (auto t2 = Clock::now(); connected && Seconds(t2) < 2;) {
+		server.Publish(maze, options.ticks);
+		matching = 0;
+		for (unique_ptr<StreamClient>& client : clients) {
+			connected = client->Poll() && connected;
+			if (Matches(client->state)) matching++;
+		}
+		if (matching == options.count) break;
+		this_thread::yield();
+	}
+
+	const StreamEncoder& encoder = server.encoder;
+	printf("{\"command\": \"stream\", \"width\": %d, \"height\": %d, \"ticks\": %d, \"clients\": %d, \"seconds\": %.6f,\n",
+		maze.width, maze.height, options.ticks, options.count, elapsed);
+	printf("\t\"snapshots\": %lld, \"snapshotBytes\": %lld, \"deltas\": %lld, \"deltaBytes\": %lld, \"bytesPerTick\": %.2f, \"bytesPerDelta\": %.2f,\n",
+		encoder.snapshots, encoder.snapshotBytes, encoder.deltas, encoder.deltaBytes, encoder.deltaBytes / (double)options.ticks, encoder.deltas ? encoder.deltaBytes / (double)encoder.deltas : 0.0);
+	printf("\t\"encodeMicrosecondsPerTick\": %.3f, \"publishMicrosecondsPerTick\": %.3f, \"bytesReceivedPerClient\": %lld, \"matchingClients\": %d}\n",
+		server.encodeTime / options.ticks * 1e6, elapsed / options.ticks * 1e6, clients.empty() ? 0 : clients[0]->bytesReceived, matching);
+
+	return connected && matching == options.count ? 0 : 1;
+}
+
+int Replay(const Options& options) {
+	if (options.files.size() != 1) {
+		fprintf(stderr, "replay needs exactly one recording\n");
+		return 2;
+	}
+
+	std::shared_ptr<Maze> maze(new Maze());
+	Replayer replayer(maze);
+	if (!replayer.Open(options.files[0])) {
+		fprintf(stderr, "%s is not a readable recording\n", options.files[0].c_str());
+		return 1;
+	}
+
+	long long ticks = 0;
+	auto t1 = Clock::now();
+	while (replayer.Tick()) ticks++;
+	double elapsed = Seconds(t1);
+	bool matches = replayer.Verify();
+
+	printf("{\"command\": \"replay\", \"file\": %s, \"width\": %d, \"height\": %d, \"seed\": %u, \"ticks\": %lld, \"seconds\": %.6f, \"ticksPerSecond\": %.0f, \"matches\": %s}\n",
+		Quote(options.files[0]).c_str(), maze->width, maze->height, maze->seed, ticks, elapsed, elapsed > 0 ? ticks / elapsed : 0.0, matches ? "true" : "false");
+
+	return matches ? 0 : 1;
+}
+
+// Steps from (0, 0) to the exit through cells holding mask, -1 if it can't be reached. A plain queue BFS, kept apart from AnalyzeBoard
+long long ReferencePath(Maze& maze, BYTE mask) {
+	if (!maze.CellCheck(0, 0, mask)) return -1;
+
+	vector<int> distance((size_t)maze.width * maze.height, -1);
+	vector<int> queue(1, 0);
+	distance[0] = 0;
+	for (size_t head = 0; head < queue.size(); head++) {
+		int x = queue[head] % maze.width;
+		int y = queue[head] / maze.width;
+		const int steps[4][2] = { { -1, 0 }, { 1, 0 }, { 0, -1 }, { 0, 1 } };
+		for (const int* step : steps) {
+			int nX = x + step[0];
+			int nY = y + step[1];
+			if (!maze.CellCheck(nX, nY, mask) || distance[nY * maze.width + nX] >= 0) continue;
+			distance[nY * maze.width + nX] = distance[queue[head]] + 1;
+			queue.push_back(nY * maze.width + nX);
+		}
+	}
+
+	return distance.back();
+}
+
+/*
+Brute-force ray cast: collects every grid line crossing up to the board edge, sorts them and tests
+the cell between each crossing and the next. Out-of-bounds cells are walls, as for Maze::CastRay
+*/
+double ReferenceCastRay(Maze& maze, double x, double y, double xComponent, double yComponent, int& cellX, int& cellY) {
+	vector<double> crossings;
+	for (int k = -1; k <= maze.width + 1 && xComponent != 0; k++) {
+		double t = (k - x) / xComponent;
+		if (t > 0) crossings.push_back(t);
+	}
+	for (int k = -1; k <= maze.height + 1 && yComponent != 0; k++) {
+		double t = (k - y) / yComponent;
+		if (t > 0) crossings.push_back(t);
+	}
+	sort(crossings.begin(), crossings.end());
+
+	for (size_t i = 0; i + 1 < crossings.size(); i++) {
+		double middle = (crossings[i] + crossings[i + 1]) / 2;
+		cellX = (int)floor(x + middle * xComponent);
+		cellY = (int)floor(y + middle * yComponent);
+		if (!maze.CellCheck(cellX, cellY, Maze::PathMask)) return crossings[i];
+	}
+
+	return crossings.empty() ? 0 : crossings.back();
+}
+
+/*
+Baseline file: one "name value" pair per line, throughputs measured on the machine that runs the
+comparison. A throughput more than tolerance percent below its baseline fails verify
+*/
+bool ReadBaseline(const string& path, vector<pair<string, double>>& values) {
+	ifstream file(path);
+	if (!file) return false;
+
+	string name;
+	double value;
+	while (file >> name >> value) values.push_back(make_pair(name, value));
+	return !values.empty();
+}
+
+int Verify(const Options& options) {
+	// A bad baseline is an error before any checks run or any JSON is written
+	vector<pair<string, double>> baseline;
+	if (!options.baseline.empty() && !ReadBaseline(options.baseline, baseline)) {
+		fprintf(stderr, "%s is not a readable baseline\n", options.baseline.c_str());
+		return 1;
+	}
+
+	Maze maze;
+	FieldOfView visibility;
+	FieldOfView reverse;
+	mt19937 random(options.seed);
+	uniform_real_distribution<double> unit(0, 1);
+
+	long long connectivityFailures = 0;
+	long long pathFailures = 0;
+	long long analysisFailures = 0;
+	long long boardFailures = 0;
+	long long rayChecks = 0;
+	long long rayFailures = 0;
+	double rayError = 0;
+	long long sightPairs = 0;
+	long long sightFailures = 0;
+	long long columnChecks = 0;
+	long long columnFailures = 0;
+	RayTable fan;
+	fan.Update(options.columns, PI / 2);
+	vector<RayHit> full;
+	vector<RayHit> adaptive;
+	const int raysPerCase = 256;
+	const int viewsPerCase = 4;
+	// Ten seconds of play per case. Between splits float stays within PhysicsTolerance cells of double,
+	// measured drift is below 5e-4 cells over 20000 ticks
+	const int physicsTicks = Maze::TickRate * 10;
+	const double PhysicsTolerance = 1e-3;
+	long long physicsFailures = 0;
+	long long physicsSplits = 0;
+	double physicsDrift = 0;
+
+	auto t1 = Clock::now();
+	for (int c = 0; c < options.cases; c++) {
+		unsigned int seed = options.seed + c;
+		maze.width = 2 + random() % (options.width - 1);
+		maze.height = 2 + random() % (options.height - 1);
+		maze.iterations = random() % (options.iterations + 1);
+		maze.Generate(seed);
+		maze.Wait();
+
+		// The exit is reachable, and the cells marked as the solution form a path to it on their own
+		long long length = ReferencePath(maze, Maze::PathMask);
+		if (length < 0) connectivityFailures++;
+		if (ReferencePath(maze, Maze::TruePathMask) < 0) pathFailures++;
+
+		bool closed = false;
+		for (int i = 0; i < maze.height; i++) {
+			for (int j = 0; j < maze.width; j++) {
+				if (maze.CellCheck(j, i, Maze::TruePathMask) && !maze.CellCheck(j, i, Maze::PathMask)) closed = true;
+			}
+		}
+		if (closed) pathFailures++;
+
+		if (AnalyzeBoard(maze.GetBoard(), maze.width, maze.height, 1).solutionLength != length) analysisFailures++;
+
+		if (connectivityFailures + pathFailures + analysisFailures > boardFailures) {
+			if (!boardFailures) fprintf(stderr, "seed %u (%dx%d, %d iterations) failed the board checks\n", seed, maze.width, maze.height, maze.iterations);
+			boardFailures = connectivityFailures + pathFailures + analysisFailures;
+		}
+
+		vector<pair<int, int>> open = OpenCells(maze);
+
+		// CastRay against the brute-force cast, distance and wall cell
+		for (int i = 0; i < raysPerCase; i++) {
+			const pair<int, int>& cell = open[random() % open.size()];
+			double x = cell.first + unit(random);
+			double y = cell.second + unit(random);
+			double angle = 2 * PI * unit(random);
+
+			RayHit hit;
+			maze.CastRay(x, y, cos(angle), sin(angle), &hit);
+			int cellX;
+			int cellY;
+			double expected = ReferenceCastRay(maze, x, y, cos(angle), sin(angle), cellX, cellY);
+
+			double error = fabs(hit.distance - expected);
+			rayError = max(rayError, error);
+			rayChecks++;
+			if (error > 1e-9 * max(1.0, expected) || hit.cellX != cellX || hit.cellY != cellY) {
+				if (!rayFailures) fprintf(stderr, "seed %u: ray from (%.17g, %.17g) at %.17g hit %.17g, expected %.17g\n", seed, x, y, angle, hit.distance, expected);
+				rayFailures++;
+			}
+		}
+
+		// Field of view is symmetric between open cells
+		for (int i = 0; i < viewsPerCase; i++) {
+			const pair<int, int>& cell = open[random() % open.size()];
+			visibility.Compute(maze, cell.first, cell.second, options.range);
+			for (int seen : visibility.visible) {
+				if (!maze.CellCheck(seen % maze.width, seen / maze.width, Maze::PathMask)) continue;
+				reverse.Compute(maze, seen % maze.width, seen / maze.width, options.range);
+				sightPairs++;
+				if (find(reverse.visible.begin(), reverse.visible.end(), cell.second * maze.width + cell.first) == reverse.visible.end()) sightFailures++;
+			}
+		}
+
+		// Adaptive column sampling hits the same walls as a ray per column
+		for (int i = 0; i < viewsPerCase; i++) {
+			const pair<int, int>& cell = open[random() % open.size()];
+			double x = cell.first + unit(random);
+			double y = cell.second + unit(random);
+			double angle = 2 * PI * unit(random);
+			fan.Cast(maze, x, y, cos(angle), sin(angle), 1, full);
+			fan.Cast(maze, x, y, cos(angle), sin(angle), options.stride, adaptive);
+
+			for (int j = 0; j < fan.columns; j++) {
+				columnChecks++;
+				if (full[j].cellX != adaptive[j].cellX || full[j].cellY != adaptive[j].cellY || full[j].side != adaptive[j].side
+					|| fabs(full[j].distance - adaptive[j].distance) > 1e-9 * max(1.0, full[j].distance)) columnFailures++;
+			}
+		}
+
+		// Float physics follows double physics within tolerance
+		double drift = PhysicsDrift(maze, physicsTicks, seed, physicsSplits);
+		physicsDrift = max(physicsDrift, drift);
+		if (drift > PhysicsTolerance) {
+			if (!physicsFailures) fprintf(stderr, "seed %u: float physics drifted %.3g cells from double\n", seed, drift);
+			physicsFailures++;
+		}
+	}
+	double checkTime = Seconds(t1);
+
+	// Throughput on a fixed board, best of five generations
+	maze.width = 512;
+	maze.height = 512;
+	maze.iterations = 5;
+	double generationBest = 1e300;
+	for (int i = 0; i < 5; i++) {
+		maze.Generate(options.seed);
+		maze.Wait();
+		generationBest = min(generationBest, maze.generationTime);
+	}
+	double meanDistance = 0;
+	vector<pair<string, double>> measured;
+	measured.push_back(make_pair(string("generationCellsPerSecond"), maze.width * (double)maze.height / generationBest));
+	measured.push_back(make_pair(string("raysPerSecond"), RayThroughput(maze, OpenCells(maze), options.rays, options.seed, meanDistance)));
+
+	bool passed = connectivityFailures + pathFailures + analysisFailures + rayFailures + sightFailures + columnFailures + physicsFailures == 0;
+
+	printf("{\"command\": \"verify\", \"cases\": %d, \"maxWidth\": %d, \"maxHeight\": %d, \"seed\": %u, \"seconds\": %.3f,\n",
+		options.cases, options.width, options.height, options.seed, checkTime);
+	printf("\t\"connectivity\": {\"failures\": %lld}, \"truePath\": {\"failures\": %lld}, \"analysis\": {\"failures\": %lld},\n",
+		connectivityFailures, pathFailures, analysisFailures);
+	printf("\t\"raycast\": {\"checks\": %lld, \"failures\": %lld, \"maxError\": %.3g},\n", rayChecks, rayFailures, rayError);
+	printf("\t\"fieldOfView\": {\"pairs\": %lld, \"failures\": %lld},\n", sightPairs, sightFailures);
+	printf("\t\"columns\": {\"stride\": %d, \"checks\": %lld, \"failures\": %lld},\n", options.stride, columnChecks, columnFailures);
+	printf("\t\"physics\": {\"ticks\": %lld, \"tolerance\": %.3g, \"maxDrift\": %.3g, \"collisionSplits\": %lld, \"failures\": %lld},\n",
+		(long long)physicsTicks * options.cases, PhysicsTolerance, physicsDrift, physicsSplits, physicsFailures);
+	printf("\t\"throughput\": {");
+	for (size_t i = 0; i < measured.size(); i++) printf("%s\"%s\": %.0f", i ? ", " : "", measured[i].first.c_str(), measured[i].second);
+	printf("}");
+
+	if (!options.baseline.empty()) {
+		printf(",\n\t\"baseline\": {\"file\": %s, \"tolerance\": %.1f, \"regressions\": [", Quote(options.baseline).c_str(), options.tolerance);
+		bool first = true;
+		for (const pair<string, double>& expected : baseline) {
+			for (const pair<string, double>& value : measured) {
+				if (value.first != expected.first || value.second >= expected.second * (1 - options.tolerance / 100)) continue;
+				printf("%s{\"name\": \"%s\", \"baseline\": %.0f, \"measured\": %.0f}", first ? "" : ", ", value.first.c_str(), expected.second, value.second);
+				first = false;
+				passed = false;
+			}
+		}
+		printf("]}");
+	}
+	printf(",\n\t\"passed\": %s\n}\n", passed ? "true" : "false");
+
+	if (!options.saveBaseline.empty()) {
+		ofstream file(options.saveBaseline, ios::trunc);
+		for (const pair<string, double>& value : measured) file << value.first << " " << (long long)value.second << "\n";
+		if (!file) {
+			fprintf(stderr, "could not write %s\n", options.saveBaseline.c_str());
+			return 1;
+		}
+	}
+
+	return passed ? 0 : 1;
+}
+
+int main(int argc, char** argv) {
+	Options options;
+	string command = argc > 1 ? argv[1] : "";
+
+	if (command.empty() || !ParseOptions(argc, argv, options)) {
+		fprintf(stderr, "usage: maze-cli generate|analyze|simulate|bench|replay|stream|verify [options] [files]\n");
+		return 2;
+	}
+
+	if (command == "generate") return Generate(options);
+	if (command == "analyze") return Analyze(options);
+	if (command == "simulate") return Simulate(options);
+	if (command == "bench") return Bench(options);
+	if (command == "replay") return Replay(options);
+	if (command == "stream") return Stream(options);
+	if (command == "verify") return Verify(options);
+
+	fprintf(stderr, "unknown command %s\n", command.c_str());
+	return 2;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+/*
+Standard-library-only base for the maze core (maze, physics, ray table, scene, agents, analysis, replay),
+so it builds without Windows headers. framework.h layers the Windows and Direct2D headers on top
+*/
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <cstdio>
+#include <climits>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <new>
+#include <algorithm>
+#include <random>
+#include <fstream>
+
+typedef unsigned char BYTE;
+
+using namespace std;
+
+template <typename T> int sgn(T val) {
+    return (T(0) < val) - (val < T(0));
+}
+
+#define PI 3.14159265358979323846
+#define SQRT_2 1.41421356237309504880
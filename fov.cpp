@@ -0,0 +1,116 @@
+#include "fov.h"
+
+// floor(numerator / denominator) for a positive denominator
+static long long FloorDivide(long long numerator, long long denominator) {
+	return numerator >= 0 ? numerator / denominator : -((-numerator + denominator - 1) / denominator);
+}
+
+FieldOfView::FieldOfView() :
+	width(0),
+	height(0),
+	epoch(0),
+	originX(0),
+	originY(0),
+	range(0),
+	revision(0),
+	valid(false)
+{}
+
+void FieldOfView::Reset(int width_, int height_) {
+	width = width_;
+	height = height_;
+	explored.assign(((size_t)width * height + 63) / 64, 0);
+	visible.clear();
+	valid = false;
+	epoch++;
+}
+
+bool FieldOfView::Explored(int x, int y) {
+	if (x < 0 || x >= width || y < 0 || y >= height) return false;
+	size_t cell = (size_t)y * width + x;
+	return (explored[cell >> 6] >> (cell & 63)) & 1;
+}
+
+bool FieldOfView::Compute(Maze& maze, int x, int y, int range_) {
+	if (maze.width != width || maze.height != height || maze.revision != revision) {
+		Reset(maze.width, maze.height);
+		revision = maze.revision;
+	}
+	else if (valid && x == originX && y == originY && range_ == range) return false;
+
+	originX = x;
+	originY = y;
+	range = max(range_, 0);
+	valid = true;
+
+	seen.resize((size_t)(2 * range + 1) * (2 * range + 1));
+	visible.clear();
+
+	Reveal(x, y);
+	for (int quadrant = 0; quadrant < 4; quadrant++) Scan(maze, quadrant);
+
+	for (int cell : visible) seen[(size_t)(cell / width - originY + range) * (2 * range + 1) + (cell % width - originX + range)] = 0;
+
+	return true;
+}
+
+void FieldOfView::Reveal(int x, int y) {
+	if (x < 0 || x >= width || y < 0 || y >= height) return;
+
+	BYTE& flag = seen[(size_t)(y - originY + range) * (2 * range + 1) + (x - originX + range)];
+	if (flag) return;
+	flag = 1;
+
+	size_t cell = (size_t)y * width + x;
+	visible.push_back((int)cell);
+	explored[cell >> 6] |= 1ull << (cell & 63);
+}
+
+void FieldOfView::Scan(Maze& maze, int quadrant) {
+	// Quadrant 0 looks towards -y, 1 towards +y, 2 towards +x and 3 towards -x. A cell is (depth, column)
+	// in quadrant space, the interval between the slopes -1 and 1 is open at the start
+	auto transform = [this, quadrant](int depth, int column, int& x, int& y) {
+		switch (quadrant) {
+		case 0: x = originX + column; y = originY - depth; break;
+		case 1: x = originX + column; y = originY + depth; break;
+		case 2: x = originX + depth; y = originY + column; break;
+		default: x = originX - depth; y = originY + column; break;
+		}
+	};
+
+	rows.clear();
+	rows.push_back({ 1, -1, 1, 1, 1 });
+
+	while (!rows.empty()) {
+		Row row = rows.back();
+		rows.pop_back();
+		if (row.depth > range) continue;
+
+		// Columns whose centre line the interval covers, rounding half-covered cells inwards on both sides
+		int first = (int)FloorDivide(2LL * row.depth * row.startNumerator + row.startDenominator, 2LL * row.startDenominator);
+		int last = -(int)FloorDivide(-(2LL * row.depth * row.endNumerator - row.endDenominator), 2LL * row.endDenominator);
+
+		// -1 before the first cell, then whether the previous cell was a wall
+		int previous = -1;
+		for (int column = first; column <= last; column++) {
+			int x, y;
+			transform(row.depth, column, x, y);
+			bool wall = !maze.CellCheck(x, y, Maze::PathMask);
+
+			// Floor cells show only if their centre lies inside the interval, which keeps the result symmetric
+			bool symmetric = (long long)column * row.startDenominator >= (long long)row.depth * row.startNumerator
+				&& (long long)column * row.endDenominator <= (long long)row.depth * row.endNumerator;
+			if ((wall || symmetric) && column * column + row.depth * row.depth <= range * range) Reveal(x, y);
+
+			if (previous == 1 && !wall) {
+				row.startNumerator = 2 * column - 1;
+				row.startDenominator = 2 * row.depth;
+			}
+			if (previous == 0 && wall) rows.push_back({ row.depth + 1, row.startNumerator, row.startDenominator, 2 * column - 1, 2 * row.depth });
+
+			previous = wall;
+		}
+
+		if (previous == 0) rows.push_back({ row.depth + 1, row.startNumerator, row.startDenominator, row.endNumerator, row.endDenominator });
+	}
+}
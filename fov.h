@@ -0,0 +1,52 @@
+#pragma once
+
+#include "core.h"
+#include "maze.h"
+
+/*
+Cells visible from a cell of the maze, by symmetric shadowcasting: each quadrant is scanned row
+by row outwards, and walls narrow the slope interval the next rows are scanned over. Work is
+proportional to the visible cells plus the walls bounding them. Out-of-bounds cells count as wall,
+as they do for Maze::CastRay
+*/
+class FieldOfView {
+public:
+	FieldOfView();
+
+	int width;
+	int height;
+	// Bumped whenever explored is cleared
+	unsigned int epoch;
+
+	// Cells seen by the last Compute as y * width + x, walls included, each once
+	vector<int> visible;
+
+	// Recomputes only when the origin cell, the range or the board changed, returns whether it did
+	bool Compute(Maze& maze, int x, int y, int range);
+	// True for cells seen since the board was generated or loaded
+	bool Explored(int x, int y);
+	void Reset(int width, int height);
+private:
+	// Slopes are kept as exact fractions so that the scan stays symmetric
+	struct Row {
+		int depth;
+		int startNumerator;
+		int startDenominator;
+		int endNumerator;
+		int endDenominator;
+	};
+
+	int originX;
+	int originY;
+	int range;
+	unsigned int revision;
+	bool valid;
+
+	vector<unsigned long long> explored;
+	// (2 * range + 1)^2 flags around the origin, cleared again after every Compute
+	vector<BYTE> seen;
+	vector<Row> rows;
+
+	void Scan(Maze& maze, int quadrant);
+	void Reveal(int x, int y);
+};
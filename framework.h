@@ -1,25 +1,25 @@
 #pragma once
 
 #include <Windows.h>
-#include <vector>
-#include <string>
-#include <chrono>
-#include <thread>
+#include <windowsx.h>
 #include <wrl.h>
-#include <unordered_set>
+
+#include "core.h"
 
 #include <d2d1.h>
 #include <d2d1helper.h>
 #include <dwrite.h>
+#include <dwmapi.h>
 
 #pragma comment(lib, "d2d1.lib")
 #pragma comment(lib, "dwrite.lib")
+#pragma comment(lib, "dwmapi.lib")
+#pragma comment(lib, "winmm.lib")
 
 #ifdef _DEBUG
 #include <crtdbg.h>
 #endif
 
-using namespace std;
 using namespace Microsoft::WRL;
 
 template<class T> inline void SafeRelease(T** ppT) {
@@ -29,12 +29,3 @@ template<class T> inline void SafeRelease(T** ppT) {
         (*ppT) = NULL;
     }
 }
-
-template <typename T> int sgn(T val) {
-    return (T(0) < val) - (val < T(0));
-}
-
-#define PI 3.14159265358979323846
-#define SQRT_2 1.41421356237309504880
-
-using namespace std;
\ No newline at end of file
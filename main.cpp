@@ -1,8 +1,9 @@
 #include "resource.h"
 #include "renderer.h"
+#include "replay.h"
+#include "spsc.h"
+#include "stream.h"
 
-int width = 1;
-int height = 1;
 #pragma region gTmc stands for grid thickness multiplication constant, per se
 const double gTmc = 0.075;
 #pragma endregion
@@ -16,7 +17,83 @@ HWND hWndG;
 std::unique_ptr<Renderer> renderer;
 std::shared_ptr<Maze> maze;
 
-void UpdateWindowSize(HWND hWnd) {
+std::unique_ptr<Recorder> recorder;
+std::unique_ptr<Replayer> replayer;
+bool fastReplay = false;
+std::atomic<bool> replaying(false);
+// Only ever touched by the simulation thread once it runs
+std::unique_ptr<StreamServer> streamer;
+
+/*
+The message thread runs WndProc, which only timestamps input and posts it to the simulation thread.
+The simulation thread owns the maze, the physics and the frame settings, and hands a copy of the
+frame description to the render thread, which owns the render target. Window changes go back to
+the message thread as WM_APP messages
+*/
+struct InputEvent {
+	UINT message;
+	WPARAM wParam;
+	int x;
+	int y;
+	// QueryPerformanceCounter time WndProc received the message at
+	LONGLONG time;
+};
+
+SpscQueue<InputEvent, 1024> inputs;
+SpscQueue<Frame, 4> frames;
+std::atomic<bool> quit(false);
+
+// Resize the window to wParam x lParam
+const UINT WM_APP_RESIZE = WM_APP + 0;
+// Input-to-photon latency over the last half second, mean in wParam and worst in lParam, in microseconds
+const UINT WM_APP_LATENCY = WM_APP + 1;
+// A replay is over, wParam is 1 if it ended in the recorded state
+const UINT WM_APP_REPLAY = WM_APP + 2;
+// Mean drawing time per frame over the last half second in wParam, the info strip's share in lParam, in microseconds
+const UINT WM_APP_FRAMETIME = WM_APP + 3;
+// Mean rays cast per mode 2 frame over the last half second in wParam, the columns they drew in lParam, both 0 outside mode 2
+const UINT WM_APP_RAYS = WM_APP + 4;
+
+// Simulation thread state
+Frame state;
+BYTE keys = 0;
+bool resetPending = false;
+
+// Left button drag pans the 2D view
+bool dragging = false;
+POINT dragFrom;
+
+// Message thread state, shown in the window title
+wstring replayStatus;
+wstring streamStatus;
+double latencyMean = 0;
+double latencyWorst = 0;
+double frameTime = 0;
+double infoTime = 0;
+double raysPerFrame = 0;
+double rayColumns = 0;
+
+void UpdateTitle() {
+	wchar_t rays[64] = L"";
+	if (rayColumns > 0) swprintf(rays, 64, L" - %.0f rays for %.0f columns", raysPerFrame, rayColumns);
+
+	wchar_t title[256];
+	swprintf(title, 256, L"Maze%ls%ls - input latency %.1f ms, worst %.1f ms - frame %.2f ms, info strip %.2f ms%ls",
+		replayStatus.c_str(), streamStatus.c_str(), latencyMean * 1000, latencyWorst * 1000, frameTime * 1000, infoTime * 1000, rays);
+	SetWindowText(hWndG, title);
+}
+
+void Regenerate(int width, int height) {
+	// A recording covers a single maze
+	if (recorder) recorder->Close();
+
+	lock_guard<mutex> lock(maze->boardLock);
+	maze->width = width;
+	maze->height = height;
+	maze->Generate();
+}
+
+void UpdateWindowSize() {
 	HMONITOR monitor = MonitorFromWindow(hWndG, MONITOR_DEFAULTTONEAREST);
 	MONITORINFO info;
 	info.cbSize = sizeof(MONITORINFO);
@@ -24,61 +101,62 @@ void UpdateWindowSize(HWND hWnd) {
 	int monitorWidth = info.rcMonitor.right - info.rcMonitor.left;
 	int monitorHeight = info.rcMonitor.bottom - info.rcMonitor.top;
 
+	int width = 1;
+	int height = 1;
 	int strive = min(monitorWidth / 2, 2 * monitorHeight / 3);
-	if (renderer->renderMode == 0 || renderer->renderMode == 1) {
+	if ((state.renderMode == 0 || state.renderMode == 1) && strive / max(maze->width, maze->height) == 0) {
+		// More cells than pixels: fractional cells without grid lines, the renderer switches to its overview
+		float pitch = strive / (float)max(maze->width, maze->height);
+		state.gridThickness = 0;
+		state.cellSize = pitch;
+		width = max((int)(maze->width * pitch), 1);
+		height = max((int)(maze->height * pitch), 1) + (state.infoStrip ? 98 : 0);
+	}
+	else if (state.renderMode == 0 || state.renderMode == 1) {
 		int div = max(maze->width, maze->height);
-		renderer->gridThickness = strive / div * gTmc;
-		width = maze->width * (strive / div) - renderer->gridThickness;
-		height = maze->height * (strive / div) - renderer->gridThickness + (renderer->infoStrip ? 98 + renderer->gridThickness : 0);
-		renderer->cellSize = strive / div - renderer->gridThickness;
-		if (renderer->renderMode == 1) width += renderer->gridThickness;
+		state.gridThickness = strive / div * gTmc;
+		width = maze->width * (strive / div) - state.gridThickness;
+		height = maze->height * (strive / div) - state.gridThickness + (state.infoStrip ? 98 + state.gridThickness : 0);
+		state.cellSize = strive / div - state.gridThickness;
+		if (state.renderMode == 1) width += state.gridThickness;
 	}
-	else if(renderer->renderMode == 2) {
+	else if(state.renderMode == 2) {
 		width = strive;
-		height = width + (renderer->infoStrip ? 136 : 0);
+		height = width + (state.infoStrip ? 136 : 0);
 	}
-	
-	renderer->Resize(width, height);
-	renderer->showPath = false;
 
-	SetWindowPos(hWnd, NULL, 0, 0, width + 16, height + 39, SWP_SHOWWINDOW | SWP_NOMOVE);
-	InvalidateRect(hWndG, NULL, NULL);
+	state.width = width;
+	state.height = height;
+	state.ResetView();
+	state.showPath = false;
+
+	// Only the message thread may move its window
+	PostMessage(hWndG, WM_APP_RESIZE, width + 16, height + 39);
 }
 
-LRESULT CALLBACK WndProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam) {
-	hWndG = hWnd;
-	switch (uMsg) {
-		case WM_NCCREATE:
-			EnableNonClientDpiScaling(hWnd);
-			break;
-		case WM_SETCURSOR:
-			SetCursor(cursor);
-			break;
+// Runs on the simulation thread
+void HandleInput(const InputEvent& input) {
+	switch (input.message) {
 		case WM_DISPLAYCHANGE:
-			UpdateWindowSize(hWnd);
-			break;
-		case WM_PAINT:
-		{
-			renderer->Render();
-			ValidateRect(hWnd, NULL);
+		case WM_DPICHANGED:
+			UpdateWindowSize();
 			break;
-		}
 		case WM_CHAR:
 		{
-			switch (wParam) {
+			switch (input.wParam) {
 			case 'M':
 			case 'm':
-				if (renderer->renderMode != 2) renderer->renderMode++;
-				else renderer->renderMode = 0;
+				if (state.renderMode != 2) state.renderMode++;
+				else state.renderMode = 0;
 
-				maze->PlayerReset();				
+				resetPending = true;
 
-				UpdateWindowSize(hWnd);
+				UpdateWindowSize();
 				break;
 			case 'H':
 			case 'h':
-				renderer->infoStrip = !renderer->infoStrip;
-				UpdateWindowSize(hWnd);
+				state.infoStrip = !state.infoStrip;
+				UpdateWindowSize();
 				break;
 			case 'F':
 			case 'f':
@@ -90,46 +168,50 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam) {
 				break;
 			case 'C':
 			case 'c':
-				renderer->showPath = !renderer->showPath;
+				state.showPath = !state.showPath;
 				break;
 			case 'E':
 			case 'e':
-				renderer->cameraRange++;
+				state.cameraRange++;
 				break;
 			case 'R':
 			case 'r':
-				if(renderer->cameraRange > 0) renderer->cameraRange--;
+				if(state.cameraRange > 0) state.cameraRange--;
+				break;
+			case 'V':
+			case 'v':
+				state.ResetView();
 				break;
 			case 'T':
 			case 't':
-				renderer->wallFrequency++;
+				state.wallFrequency++;
 				break;
 			case 'Y':
 			case 'y':
-				if(renderer->wallFrequency > 0) renderer->wallFrequency--;
+				if(state.wallFrequency > 0) state.wallFrequency--;
+				break;
+			case 'Z':
+			case 'z':
+				state.rayStride = state.rayStride > 1 ? 1 : 8;
 				break;
 			case '+':
-				maze->width += 1;
-				maze->Generate();
-				UpdateWindowSize(hWnd);
+				Regenerate(maze->width + 1, maze->height);
+				UpdateWindowSize();
 				break;
 			case '-':
 				if (maze->width > 3) {
-					maze->width -= 1;
-					maze->Generate();
-					UpdateWindowSize(hWnd);
+					Regenerate(maze->width - 1, maze->height);
+					UpdateWindowSize();
 				}
 				break;
 			case '=':
-				maze->height += 1;
-				maze->Generate();
-				UpdateWindowSize(hWnd);
+				Regenerate(maze->width, maze->height + 1);
+				UpdateWindowSize();
 				break;
 			case '_':
 				if (maze->height > 3) {
-					maze->height -= 1;
-					maze->Generate();
-					UpdateWindowSize(hWnd);
+					Regenerate(maze->width, maze->height - 1);
+					UpdateWindowSize();
 				}
 				break;
 			}
@@ -137,66 +219,170 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam) {
 		}
 		case WM_KEYDOWN:
 		{
-			switch (wParam) {
+			switch (input.wParam) {
 			case VK_RETURN:
-				renderer->showPath = false;
-				maze->Generate();
+				state.showPath = false;
+				Regenerate(maze->width, maze->height);
 				break;
 			case 0x57:
 			case VK_UP:
-				if (renderer->renderMode == 0 && maze->y > 0 && maze->CellCheck((int)maze->x, (int)maze->y - 1, Maze::PathMask)) maze->y--;
-				else if (renderer->renderMode > 0) maze->keyForward = true;
+				if (state.renderMode == 0 && maze->player.y > 0 && maze->CellCheck((int)maze->player.x, (int)maze->player.y - 1, Maze::PathMask)) maze->player.y--;
+				else if (state.renderMode > 0) keys |= ReplayFormat::KeyForward;
 				break;
 			case 0x53:
 			case VK_DOWN:
-				if (renderer->renderMode == 0 && maze->y < maze->height - 1 && maze->CellCheck((int)maze->x, (int)maze->y + 1, Maze::PathMask)) maze->y++;
-				else if (renderer->renderMode > 0) maze->keyBackward = true;
+				if (state.renderMode == 0 && maze->player.y < maze->height - 1 && maze->CellCheck((int)maze->player.x, (int)maze->player.y + 1, Maze::PathMask)) maze->player.y++;
+				else if (state.renderMode > 0) keys |= ReplayFormat::KeyBackward;
 				break;
 			case 0x41:
 			case VK_LEFT:
-				if (renderer->renderMode == 0 && maze->x > 0 && maze->CellCheck((int)maze->x - 1, (int)maze->y, Maze::PathMask)) maze->x--;
-				else if (renderer->renderMode > 0) maze->keyRight = true;
+				if (state.renderMode == 0 && maze->player.x > 0 && maze->CellCheck((int)maze->player.x - 1, (int)maze->player.y, Maze::PathMask)) maze->player.x--;
+				else if (state.renderMode > 0) keys |= ReplayFormat::KeyRight;
 				break;
 			case 0x44:
 			case VK_RIGHT:
-				if (renderer->renderMode == 0 && maze->x < maze->width - 1 && maze->CellCheck((int)maze->x + 1, (int)maze->y, Maze::PathMask)) maze->x++;
-				else if (renderer->renderMode > 0) maze->keyLeft = true;
+				if (state.renderMode == 0 && maze->player.x < maze->width - 1 && maze->CellCheck((int)maze->player.x + 1, (int)maze->player.y, Maze::PathMask)) maze->player.x++;
+				else if (state.renderMode > 0) keys |= ReplayFormat::KeyLeft;
 				break;
 			}
 			break;
 		}
 		case WM_KEYUP:
 		{
-			if (renderer->renderMode > 0) {
-				switch (wParam) {
+			if (state.renderMode > 0) {
+				switch (input.wParam) {
 				case 0x57:
 				case VK_UP:
-					maze->keyForward = false;
+					keys &= (BYTE)~ReplayFormat::KeyForward;
 					break;
 				case 0x53:
 				case VK_DOWN:
-					maze->keyBackward = false;
+					keys &= (BYTE)~ReplayFormat::KeyBackward;
 					break;
 				case 0x41:
 				case VK_LEFT:
-					maze->keyRight = false;
+					keys &= (BYTE)~ReplayFormat::KeyRight;
 					break;
 				case 0x44:
 				case VK_RIGHT:
-					maze->keyLeft = false;
+					keys &= (BYTE)~ReplayFormat::KeyLeft;
 					break;
 				}
 			}
 			break;
 		}
+		case WM_MOUSEWHEEL:
+			if (state.renderMode == 2) break;
+
+			state.Zoom(pow(1.25f, GET_WHEEL_DELTA_WPARAM(input.wParam) / (float)WHEEL_DELTA), input.x, input.y);
+			state.ClampView(maze->width, maze->height);
+			break;
+		case WM_LBUTTONDOWN:
+			dragging = true;
+			dragFrom = { input.x, input.y };
+			break;
+		case WM_MOUSEMOVE:
+			if (dragging) {
+				state.Pan(input.x - dragFrom.x, input.y - dragFrom.y);
+				state.ClampView(maze->width, maze->height);
+				dragFrom = { input.x, input.y };
+			}
+			break;
+		case WM_LBUTTONUP:
+			dragging = false;
+			break;
+	}
+}
+
+void PostInput(InputEvent input) {
+	LARGE_INTEGER now;
+	QueryPerformanceCounter(&now);
+	input.time = now.QuadPart;
+
+	// The simulation thread drains the queue every millisecond, a full one is never full for long
+	while (!inputs.Push(input) && !quit) this_thread::yield();
+}
+
+// QueryPerformanceCounter time of the first vertical blank after now, now itself if the compositor can't tell
+LONGLONG NextVBlank(LONGLONG now) {
+	DWM_TIMING_INFO timing = {};
+	timing.cbSize = sizeof(DWM_TIMING_INFO);
+	if (FAILED(DwmGetCompositionTimingInfo(NULL, &timing)) || timing.qpcRefreshPeriod == 0) return now;
+
+	LONGLONG vblank = (LONGLONG)timing.qpcVBlank;
+	LONGLONG period = (LONGLONG)timing.qpcRefreshPeriod;
+	if (vblank <= now) vblank += ((now - vblank) / period + 1) * period;
+	return vblank;
+}
+
+LRESULT CALLBACK WndProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam) {
+	hWndG = hWnd;
+	InputEvent input = { uMsg, wParam, GET_X_LPARAM(lParam), GET_Y_LPARAM(lParam), 0 };
+	switch (uMsg) {
+		case WM_NCCREATE:
+			EnableNonClientDpiScaling(hWnd);
+			break;
+		case WM_SETCURSOR:
+			SetCursor(cursor);
+			break;
+		case WM_PAINT:
+			// The render thread draws continuously
+			ValidateRect(hWnd, NULL);
+			break;
+		case WM_CHAR:
+		case WM_KEYDOWN:
+		case WM_KEYUP:
+			// A replay owns the input until it is over
+			if (!replaying) PostInput(input);
+			break;
+		case WM_MOUSEWHEEL:
+		{
+			POINT point = { input.x, input.y };
+			ScreenToClient(hWnd, &point);
+			input.x = point.x;
+			input.y = point.y;
+			PostInput(input);
+			break;
+		}
+		case WM_LBUTTONDOWN:
+			SetCapture(hWnd);
+			PostInput(input);
+			break;
+		case WM_LBUTTONUP:
+			ReleaseCapture();
+			PostInput(input);
+			break;
+		case WM_MOUSEMOVE:
+		case WM_DISPLAYCHANGE:
 		case WM_DPICHANGED:
-			UpdateWindowSize(hWnd);
+			PostInput(input);
+			break;
+		case WM_APP_RESIZE:
+			SetWindowPos(hWnd, NULL, 0, 0, (int)wParam, (int)lParam, SWP_SHOWWINDOW | SWP_NOMOVE);
+			break;
+		case WM_APP_LATENCY:
+			latencyMean = wParam / 1e6;
+			latencyWorst = lParam / 1e6;
+			UpdateTitle();
+			break;
+		case WM_APP_FRAMETIME:
+			frameTime = wParam / 1e6;
+			infoTime = lParam / 1e6;
+			UpdateTitle();
+			break;
+		case WM_APP_RAYS:
+			raysPerFrame = (double)wParam;
+			rayColumns = (double)lParam;
+			UpdateTitle();
+			break;
+		case WM_APP_REPLAY:
+			replayStatus = wParam ? L" - replay matches the recording" : L" - replay diverged from the recording";
+			UpdateTitle();
 			break;
 		case WM_DESTROY:
 			PostQuitMessage(0);
 			break;
 	}
-	if (maze && (int)trunc(maze->x) == maze->width - 1 && (int)trunc(maze->y) == maze->height - 1) renderer->showPath = true;
 	return DefWindowProc(hWnd, uMsg, wParam, lParam);
 }
 
@@ -217,60 +403,258 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PWSTR pCmdLine
 		WS_OVERLAPPEDWINDOW & ~(WS_THICKFRAME | WS_MAXIMIZEBOX),
 		CW_USEDEFAULT,
 		CW_USEDEFAULT,
-		width,
-		height,
+		state.width,
+		state.height,
 		NULL,
 		NULL,
 		hInstance,
 		NULL
 	);
 
-	maze = std::shared_ptr<Maze>(new Maze(hWndG));
-	maze->Generate();
+	maze = std::shared_ptr<Maze>(new Maze());
+
+	/*
+	/record <file> logs this session's physics input, /replay <file> plays one back
+	at the recorded speed or, with /fast, as fast as possible. /nocache lays the info strip
+	text out again every frame, to compare frame times against the cached layouts. /stream <port>
+	serves the session to spectators on 127.0.0.1, see stream.h
+	*/
+	string recordPath;
+	string replayPath;
+	bool cacheInfoStrip = true;
+	int streamPort = -1;
+	int argc = 0;
+	LPWSTR* argv = CommandLineToArgvW(GetCommandLineW(), &argc);
+	for (int i = 1; argv && i < argc; i++) {
+		char path[MAX_PATH] = {};
+		if (i + 1 < argc) WideCharToMultiByte(CP_ACP, 0, argv[i + 1], -1, path, MAX_PATH, NULL, NULL);
+
+		if (wcscmp(argv[i], L"/record") == 0 && i + 1 < argc) recordPath = path, i++;
+		else if (wcscmp(argv[i], L"/replay") == 0 && i + 1 < argc) replayPath = path, i++;
+		else if (wcscmp(argv[i], L"/fast") == 0) fastReplay = true;
+		else if (wcscmp(argv[i], L"/nocache") == 0) cacheInfoStrip = false;
+		else if (wcscmp(argv[i], L"/stream") == 0 && i + 1 < argc) streamPort = _wtoi(argv[i + 1]), i++;
+	}
+	if (argv) LocalFree(argv);
 
 	renderer = std::unique_ptr<Renderer>(new Renderer(hWndG, maze));
+	renderer->cacheInfoStrip = cacheInfoStrip;
 
-	UpdateWindowSize(hWndG);
+	if (streamPort >= 0) {
+		streamer = std::unique_ptr<StreamServer>(new StreamServer());
+		if (streamer->Open(streamPort)) streamStatus = L" - streaming on port " + to_wstring(streamer->port);
+		else {
+			streamer.reset();
+			streamStatus = L" - stream port could not be opened";
+		}
+		UpdateTitle();
+	}
+
+	if (!replayPath.empty()) {
+		replayer = std::unique_ptr<Replayer>(new Replayer(maze));
+		if (replayer->Open(replayPath)) {
+			state.renderMode = replayer->renderMode;
+			replaying = true;
+		}
+		else {
+			replayer.reset();
+			replayStatus = L" - replay could not be loaded";
+			UpdateTitle();
+		}
+	}
+
+	if (!replayer) {
+		maze->Generate();
+
+		if (!recordPath.empty()) {
+			// Recording starts on a finished board so that the physics never sees a partial one
+			maze->Wait();
+			state.renderMode = 1;
+			recorder = std::unique_ptr<Recorder>(new Recorder(maze));
+			if (!recorder->Open(recordPath, state.renderMode)) recorder.reset();
+		}
+	}
+
+	UpdateWindowSize();
 
 	UpdateWindow(hWndG);
 	ShowWindow(hWndG, SW_SHOW);
 
-	MSG msg = {};
-	bool quit = false;
+	// Sleep(1) sleeps a whole scheduler tick otherwise
+	timeBeginPeriod(1);
 
-	thread render([&quit] {
+	thread simulation([] {
 		LARGE_INTEGER frequency;
 		LARGE_INTEGER t1, t2;
 
 		QueryPerformanceFrequency(&frequency);
 		QueryPerformanceCounter(&t1);
+		const LONGLONG start = t1.QuadPart;
+
+		const double step = 1.0 / Maze::TickRate;
+		double accumulator = 0;
+		// Oldest input no frame has shown yet
+		LONGLONG inputTime = 0;
 
 		while (!quit) {
-			InvalidateRect(hWndG, NULL, FALSE);
 			Sleep(1);
 			QueryPerformanceCounter(&t2);
+			accumulator = min(accumulator + (t2.QuadPart - t1.QuadPart) * 1.0 / frequency.QuadPart, 0.25);
+			t1 = t2;
 
-			if (renderer->renderMode != 0) {
-				maze->PlayerUpdate((t2.QuadPart - t1.QuadPart) * 1.0 / frequency.QuadPart, &t1);
-				if ((int)trunc(maze->x) == width - 1 && (int)trunc(maze->y) == height - 1) renderer->showPath = true;
+			InputEvent input;
+			while (inputs.Pop(input)) {
+				if (!inputTime) inputTime = input.time;
+				HandleInput(input);
 			}
+
+			if (replayer) {
+				if (fastReplay) for (int i = 0; i < Maze::TickRate && replayer->Tick(); i++);
+				else for (; accumulator >= step && replayer->Tick(); accumulator -= step);
+
+				if (replayer->Finished()) {
+					PostMessage(hWndG, WM_APP_REPLAY, replayer->Verify() ? 1 : 0, 0);
+					replayer.reset();
+					replaying = false;
+					keys = 0;
+				}
+			}
+			else {
+				if (state.renderMode != 0) {
+					// A reset waits for the next tick, so that the recording logs it on the tick it happens
+					for (; accumulator >= step; accumulator -= step) {
+						bool reset = resetPending;
+						resetPending = false;
+						if (reset) {
+							keys = 0;
+							maze->PlayerReset();
+						}
+
+						SetKeyState(maze.get(), keys);
+						if (recorder) recorder->Tick(reset);
+						maze->PlayerUpdate(step);
+					}
+				}
+				else {
+					if (resetPending) {
+						keys = 0;
+						maze->PlayerReset();
+						resetPending = false;
+					}
+
+					// Grid moves in mode 0 bypass the physics, so they end a recording
+					if (recorder) recorder->Close();
+					accumulator = 0;
+				}
+			}
+
+			if ((int)trunc(maze->player.x) == maze->width - 1 && (int)trunc(maze->player.y) == maze->height - 1) state.showPath = true;
+
+			// Stream ticks count wall time, so they keep running through mode 0 and fast replays
+			if (streamer) streamer->Publish(*maze, (unsigned int)((t2.QuadPart - start) * Maze::TickRate / frequency.QuadPart));
+
+			state.playerX = maze->player.x;
+			state.playerY = maze->player.y;
+			state.playerDirection = maze->GetPlayerDirection();
+			state.iterations = maze->iterations;
+			state.inputTime = inputTime;
+
+			// A full queue means the render thread is behind, the input then waits for the next frame
+			if (frames.Push(state)) inputTime = 0;
 		}
 	});
 
-	while (!quit) {
-		while (PeekMessage(&msg, NULL, 0, 0, PM_REMOVE)) {
-			if (msg.message == WM_QUIT) {
-				quit = true;	
-				break;
+	thread render([] {
+		LARGE_INTEGER frequency;
+		LARGE_INTEGER now;
+		QueryPerformanceFrequency(&frequency);
+
+		Frame frame;
+		bool fresh = false;
+		LONGLONG inputTime = 0;
+		LONGLONG latch = 0;
+
+		double latencySum = 0;
+		double latencyWorst = 0;
+		int latencyCount = 0;
+		double frameSum = 0;
+		double infoSum = 0;
+		long long raySum = 0;
+		long long columnSum = 0;
+		int frameCount = 0;
+		LONGLONG reported = 0;
+
+		while (!quit) {
+			// Only the newest frame is drawn, an input first shown by a skipped one waits for it
+			Frame next;
+			while (frames.Pop(next)) {
+				if (!inputTime) inputTime = next.inputTime;
+				frame = next;
+				fresh = true;
 			}
-			else {
-				TranslateMessage(&msg);
-				DispatchMessage(&msg);
+
+			QueryPerformanceCounter(&now);
+			if (!fresh || now.QuadPart < latch) {
+				// Sleep(1) may overshoot by a millisecond, spin through the last two
+				if (!fresh || latch - now.QuadPart > frequency.QuadPart / 500) Sleep(1);
+				else this_thread::yield();
+				continue;
 			}
+
+			renderer->Render(frame);
+			fresh = false;
+			frameSum += renderer->frameTime;
+			infoSum += renderer->infoTime;
+			raySum += renderer->raysCast;
+			columnSum += renderer->rayColumns;
+			frameCount++;
+
+			QueryPerformanceCounter(&now);
+			if (inputTime) {
+				double latency = (now.QuadPart - inputTime) * 1.0 / frequency.QuadPart;
+				latencySum += latency;
+				latencyWorst = max(latencyWorst, latency);
+				latencyCount++;
+				inputTime = 0;
+			}
+
+			if (now.QuadPart - reported > frequency.QuadPart / 2) {
+				if (latencyCount > 0) PostMessage(hWndG, WM_APP_LATENCY, (WPARAM)(latencySum / latencyCount * 1e6), (LPARAM)(latencyWorst * 1e6));
+				PostMessage(hWndG, WM_APP_FRAMETIME, (WPARAM)(frameSum / frameCount * 1e6), (LPARAM)(infoSum / frameCount * 1e6));
+				PostMessage(hWndG, WM_APP_RAYS, (WPARAM)(raySum / frameCount), (LPARAM)(columnSum / frameCount));
+				latencySum = 0;
+				latencyWorst = 0;
+				latencyCount = 0;
+				frameSum = 0;
+				infoSum = 0;
+				raySum = 0;
+				columnSum = 0;
+				frameCount = 0;
+				reported = now.QuadPart;
+			}
+
+			/*
+			EndDraw returns once the frame is queued for the next vertical blank, so a frame started right
+			after it would show state that is a whole refresh old. Start the next one just early enough
+			to make the following blank instead, with a millisecond to spare
+			*/
+			LONGLONG drawTime = (LONGLONG)(renderer->frameTime * frequency.QuadPart);
+			latch = NextVBlank(now.QuadPart) - drawTime - frequency.QuadPart / 1000;
 		}
+	});
+
+	MSG msg = {};
+	while (GetMessage(&msg, NULL, 0, 0) > 0) {
+		TranslateMessage(&msg);
+		DispatchMessage(&msg);
 	}
-	
+
+	quit = true;
+	simulation.join();
 	render.join();
+	timeEndPeriod(1);
+
+	if (recorder) recorder->Close();
 
 	return 0;
 }
\ No newline at end of file
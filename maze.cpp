@@ -1,55 +1,82 @@
 #include "maze.h"
 
-long PairToLong(int x, int y) {
-	return (x << 16) + y;
-}
-
-Maze::Maze(HWND hWnd_) :
-	hWnd(hWnd_),
-	board(nullptr),
-	x(0.5),
-	y(0.5),
+Maze::Maze() :
 	width(10),
 	height(10),
 	iterations(5),
-	dying(false),
-	moves(vector<pair<int, int>>()),
-	turns(vector<pair<int, int>>()),
-	closedMoves(unordered_set<long>()),
+	seed(0),
+	revision(0),
+	generated(false),
+	generationTime(0),
+	generationFailed(false),
 
 	keyForward(false),
 	keyBackward(false),
 	keyLeft(false),
 	keyRight(false),
 
-	xVelocity(0.0),
-	yVelocity(0.0),
-	direction(0.0),
-	angularVelocity(0.0),
-
-	acceleration(0.003),
-	friction(0.03),
-	angularAcceleration(0.005),
-	angularFriction(0.05)
-{}
+	dying(false),
+	board(nullptr),
+	boardWidth(0),
+	boardHeight(0)
+{
+	PlayerInitialize(player, 0.5, 0.5, 0.0);
+}
 
 Maze::~Maze() {
 	dying = true;
-	generation.join();
+	Wait();
 
-	if (board) free(board);
+	delete[] board;
 	board = nullptr;
 }
 
-void Maze::Reallocate() {
-	if (board) free(board);
-	board = (BYTE*)malloc(sizeof(BYTE) * width * height);
-	if (board) memset(board, 0, sizeof(BYTE) * width * height);
-	if (!board) Reallocate();
+bool Maze::Reallocate() {
+	size_t cells = (size_t)width * height;
+
+	// A board of the same cell count is cleared and reused
+	if (!board || cells != (size_t)boardWidth * boardHeight) {
+		BYTE* fresh = new (nothrow) BYTE[cells];
+		if (!fresh) {
+			// Out of memory: keep the current board and fall back to its size
+			width = boardWidth;
+			height = boardHeight;
+			if (board) memset(board, 0, sizeof(BYTE) * width * height);
+			return false;
+		}
+
+		delete[] board;
+		board = fresh;
+	}
+
+	boardWidth = width;
+	boardHeight = height;
+	memset(board, 0, sizeof(BYTE) * cells);
+
+	return true;
+}
+
+bool Maze::ReserveArena() {
+	// Every move carves a new cell, and every turn is followed by one. The first pass carves each
+	// cell at most once and the iterations can only re-carve cells the first pass closed
+	size_t cells = (size_t)width * height;
+
+	try {
+		if (moves.capacity() < cells) moves.reserve(cells);
+		if (turns.capacity() < 2 * cells) turns.reserve(2 * cells);
+	}
+	catch (const bad_alloc&) {
+		// Release what was reserved, the stacks will grow on demand instead
+		vector<unsigned int>().swap(moves);
+		vector<unsigned int>().swap(turns);
+		return false;
+	}
+
+	return true;
 }
 
 bool Maze::CellCheck(int x, int y, BYTE mask) {
-	if (x < width && x >= 0 && y < height && y >= 0) return (board[y * width + x] & mask) != 0;
+	if (x < width && x >= 0 && y < height && y >= 0) return (board[(size_t)y * width + x] & mask) != 0;
 	else return false;
 }
 
@@ -58,19 +85,39 @@ int Maze::PathsAround(int x, int y) {
 }
 
 void Maze::CellAssign(int x, int y, BYTE mask) {
-	if (x < width && x >= 0 && y < height && y >= 0) board[y * width + x] |= mask;
+	if (x < width && x >= 0 && y < height && y >= 0) board[(size_t)y * width + x] |= mask;
 	return;
 }
 
 void Maze::CellRemove(int x, int y, BYTE mask) {
-	if (x < width && x >= 0 && y < height && y >= 0) board[y * width + x] ^= mask;
+	if (x < width && x >= 0 && y < height && y >= 0) board[(size_t)y * width + x] ^= mask;
 	return;
 }
 
 void Maze::GenerateT() {
-	long long seed = chrono::steady_clock().now().time_since_epoch().count() % MAXINT32;
+	auto t1 = chrono::steady_clock::now();
 
-	srand(seed);
+	try {
+		Carve();
+	}
+	catch (const bad_alloc&) {
+		// Ran out of memory while the stacks grew, the board stays as carved so far
+		for (size_t i = 0; i < (size_t)width * height; i++) board[i] &= ~ClosedMask;
+		generationFailed = true;
+	}
+
+	generationTime = chrono::duration<double>(chrono::steady_clock::now() - t1).count();
+
+	if (!dying) {
+		generated = true;
+		revision++;
+	}
+}
+
+void Maze::Carve() {
+	if (!board) return;
+
+	mt19937 random(seed);
 
 	moves.clear();
 	turns.clear();
@@ -81,18 +128,20 @@ void Maze::GenerateT() {
 	CellAssign(0, 0, TruePathMask);
 
 	int currentDirection = -1;
+	int directions[4];
+	int count;
 
 	while (!dying && (cX != width - 1 || cY != height - 1)) {
-		directions.clear();
-		if (cX > 0 && PathsAround(cX - 1, cY) == 1 && closedMoves.find(PairToLong(cX - 1, cY)) == closedMoves.end()) directions.push_back(0);
-		if (cX < width - 1 && PathsAround(cX + 1, cY) == 1 && closedMoves.find(PairToLong(cX + 1, cY)) == closedMoves.end()) directions.push_back(1);
-		if (cY > 0 && PathsAround(cX, cY - 1) == 1 && closedMoves.find(PairToLong(cX, cY - 1)) == closedMoves.end()) directions.push_back(2);
-		if (cY < height - 1 && PathsAround(cX, cY + 1) == 1 && closedMoves.find(PairToLong(cX, cY + 1)) == closedMoves.end()) directions.push_back(3);
-		if (directions.size() > 0) {
-			int direction = directions[rand() % directions.size()];
+		count = 0;
+		if (cX > 0 && PathsAround(cX - 1, cY) == 1 && !CellCheck(cX - 1, cY, ClosedMask)) directions[count++] = 0;
+		if (cX < width - 1 && PathsAround(cX + 1, cY) == 1 && !CellCheck(cX + 1, cY, ClosedMask)) directions[count++] = 1;
+		if (cY > 0 && PathsAround(cX, cY - 1) == 1 && !CellCheck(cX, cY - 1, ClosedMask)) directions[count++] = 2;
+		if (cY < height - 1 && PathsAround(cX, cY + 1) == 1 && !CellCheck(cX, cY + 1, ClosedMask)) directions[count++] = 3;
+		if (count > 0) {
+			int direction = directions[random() % count];
 			if (currentDirection != direction) {
 				currentDirection = direction;
-				turns.push_back({ cX, cY });
+				turns.push_back((unsigned int)cY * width + cX);
 			}
 			switch (direction) {
 			case 0:
@@ -110,36 +159,37 @@ void Maze::GenerateT() {
 			}
 			CellAssign(cX, cY, PathMask);
 			CellAssign(cX, cY, TruePathMask);
-			moves.push_back({ cX, cY });
+			moves.push_back((unsigned int)cY * width + cX);
 		}
 		else {
 			CellRemove(cX, cY, PathMask);
 			CellRemove(cX, cY, TruePathMask);
-			closedMoves.insert(PairToLong(cX, cY));
+			CellAssign(cX, cY, ClosedMask);
 			if (moves.size() > 0) moves.pop_back();
-			if (moves.size() > 0) cX = moves[moves.size() - 1].first;
-			if (moves.size() > 0) cY = moves[moves.size() - 1].second;
+			if (moves.size() > 0) cX = moves.back() % width;
+			if (moves.size() > 0) cY = moves.back() / width;
 		}
 	}
-	closedMoves.clear();
+
+	for (size_t i = 0; i < (size_t)width * height; i++) board[i] &= ~ClosedMask;
 
 	for (int j = 0; j < iterations; j++) {
 		currentDirection = -1;
-		int k = turns.size();
-		for (int i = 0; i < k; i++) {
-			cX = turns[i].first;
-			cY = turns[i].second;
+		size_t k = turns.size();
+		for (size_t i = 0; i < k; i++) {
+			cX = turns[i] % width;
+			cY = turns[i] / width;
 			while (!dying) {
-				directions.clear();
-				if (cX > 0 && PathsAround(cX - 1, cY) == 1) directions.push_back(0);
-				if (cX < width - 1 && PathsAround(cX + 1, cY) == 1) directions.push_back(1);
-				if (cY > 0 && PathsAround(cX, cY - 1) == 1) directions.push_back(2);
-				if (cY < height - 1 && PathsAround(cX, cY + 1) == 1) directions.push_back(3);
-				if (directions.size() > 0) {
-					int direction = directions[rand() % directions.size()];
+				count = 0;
+				if (cX > 0 && PathsAround(cX - 1, cY) == 1) directions[count++] = 0;
+				if (cX < width - 1 && PathsAround(cX + 1, cY) == 1) directions[count++] = 1;
+				if (cY > 0 && PathsAround(cX, cY - 1) == 1) directions[count++] = 2;
+				if (cY < height - 1 && PathsAround(cX, cY + 1) == 1) directions[count++] = 3;
+				if (count > 0) {
+					int direction = directions[random() % count];
 					if (currentDirection != direction) {
 						currentDirection = direction;
-						turns.push_back({ cX, cY });
+						turns.push_back((unsigned int)cY * width + cX);
 					}
 					switch (direction) {
 					case 0:
@@ -161,168 +211,176 @@ void Maze::GenerateT() {
 			}
 		}
 	}
-
-	return;
 }
 
 void Maze::Generate() {
+	Generate(chrono::steady_clock().now().time_since_epoch().count() % INT32_MAX);
+}
+
+void Maze::Generate(unsigned int seed_) {
 	dying = true;
 	if(generation.joinable()) generation.join();
 	dying = false;
 
-	Reallocate();
+	seed = seed_;
+	generated = false;
+	generationFailed = !Reallocate();
+	ReserveArena();
 	generation = thread(&Maze::GenerateT, this);
 
-	x = 0.5;
-	y = 0.5;
+	player.x = 0.5;
+	player.y = 0.5;
 }
 
-void Maze::PlayerUpdate(double delta, LARGE_INTEGER* timepoint) {
-	QueryPerformanceCounter(timepoint);
+void Maze::Wait() {
+	if (generation.joinable()) generation.join();
+}
 
-	double dt = delta * 30.0;
+/*
+Saved board layout, little-endian: "MZBD", i32 width, i32 height, u32 seed, i32 iterations,
+then width * height cell bytes holding PathMask and TruePathMask, row by row
+*/
+bool Maze::Save(const string& path) {
+	Wait();
 
-	if (keyLeft && !keyRight) angularVelocity += angularAcceleration * dt;
-	else if (keyRight) angularVelocity -= angularAcceleration * dt;
-	angularVelocity *= (1 - angularFriction * dt);
-	direction += angularVelocity * dt;
+	ofstream file(path, ios::binary | ios::trunc);
+	if (!file || !board) return false;
 
-	double xComponent = cos(direction);
-	double yComponent = sin(direction);
+	int header[4] = { width, height, (int)seed, iterations };
+	file.write("MZBD", 4);
+	file.write((const char*)header, sizeof(header));
+	file.write((const char*)board, sizeof(BYTE) * width * height);
 
-	if (keyForward && !keyBackward) {
-		xVelocity += xComponent * acceleration * dt;
-		yVelocity += yComponent * acceleration * dt;
-	}
-	else if (keyBackward) {
-		xVelocity -= xComponent * acceleration * dt;
-		yVelocity -= yComponent * acceleration * dt;
+	return (bool)file;
+}
+
+bool Maze::Load(const string& path) {
+	ifstream file(path, ios::binary);
+	if (!file) return false;
+
+	char magic[4];
+	int header[4];
+	if (!file.read(magic, 4) || memcmp(magic, "MZBD", 4) != 0) return false;
+	if (!file.read((char*)header, sizeof(header)) || header[0] < 1 || header[1] < 1) return false;
+
+	// Read into a board of its own, so a failed load leaves the current board and parameters alone
+	size_t cells = (size_t)header[0] * header[1];
+	BYTE* fresh = new (nothrow) BYTE[cells];
+	if (!fresh) return false;
+	if (!file.read((char*)fresh, sizeof(BYTE) * cells)) {
+		delete[] fresh;
+		return false;
 	}
-	xVelocity *= (1 - friction * dt);
-	yVelocity *= (1 - friction * dt);
 
-	bool fullScaleCheck = true;
+	dying = true;
+	Wait();
+	dying = false;
 
-	if (CastRay(x, y, 0) - xVelocity * dt < 1 / 10.0 - 1 / 100.0 || CastRay(x, y, PI) + xVelocity * dt < 1 / 10.0 - 1 / 100.0) {
-		xVelocity = 0;
-		fullScaleCheck = false;
-	}
-	else x += xVelocity * dt;
+	delete[] board;
+	board = fresh;
+	width = boardWidth = header[0];
+	height = boardHeight = header[1];
+	seed = header[2];
+	iterations = header[3];
 
-	if (CastRay(x, y, PI / 2) - yVelocity * dt < 1 / 10.0 - 1 / 100.0 || CastRay(x, y, 3 * PI / 2) + yVelocity * dt < 1 / 10.0 - 1 / 100.0) {
-		yVelocity = 0;
-		fullScaleCheck = false;
-	}
-	else y += yVelocity * dt;
+	player.x = 0.5;
+	player.y = 0.5;
+	generated = true;
+	revision++;
 
-	if (fullScaleCheck) {
-		for (double i = direction - PI; i < direction + PI; i += PI / 40) {
-			double dist = CastRay(x, y, i);
+	return true;
+}
 
-			if (dist < 1 / 10.0 - 1 / 100.0) {
-				x -= xVelocity * dt;
-				y -= yVelocity * dt;
-				xVelocity *= 0;
-				yVelocity *= 0;
-				break;
-			}
-		}
-	}
+void Maze::PlayerUpdate(double delta) {
+	PlayerInput input = { keyForward, keyBackward, keyLeft, keyRight };
+	PlayerStep(player, input, delta, *this);
 }
 
 void Maze::PlayerReset() {
-	xVelocity = 0;
-	yVelocity = 0;
-	angularVelocity = 0;
+	player.xVelocity = 0;
+	player.yVelocity = 0;
+	player.angularVelocity = 0;
 	keyForward = false;
 	keyBackward = false;
 	keyLeft = false;
 	keyRight = false;
 }
 
-double Maze::CastRay(double x, double y, double direction) {
-	double xComponent = cos(direction);
-	double yComponent = sin(direction);
-
-	double minimum = LONG_MAX;
+unsigned long long Maze::StateHash() {
+	// FNV-1a over the player state and the board
+	unsigned long long hash = 14695981039346656037ull;
+	auto mix = [&hash](const void* data, size_t size) {
+		for (size_t i = 0; i < size; i++) {
+			hash ^= ((const BYTE*)data)[i];
+			hash *= 1099511628211ull;
+		}
+	};
 
-	if (xComponent != 0 && yComponent != 0) {
-		double slope = yComponent / xComponent;
+	mix(&player.x, sizeof(player.x));
+	mix(&player.y, sizeof(player.y));
+	mix(&player.xVelocity, sizeof(player.xVelocity));
+	mix(&player.yVelocity, sizeof(player.yVelocity));
+	mix(&player.direction, sizeof(player.direction));
+	mix(&player.angularVelocity, sizeof(player.angularVelocity));
+	if (board) mix(board, sizeof(BYTE) * width * height);
 
-		if (yComponent > 0) {
-			for (int i = (int)y + 1; i <= height; i++) {
-				double x_0 = (i - y) / slope + x;
+	return hash;
+}
 
-				double dist = (x_0 - x) * (x_0 - x) + (y - i) * (y - i);
+double Maze::CastRay(double x, double y, double direction) {
+	return CastRay(x, y, cos(direction), sin(direction));
+}
 
-				if (!CellCheck((int)x_0, i, PathMask) && minimum > dist) minimum = dist;
-			}
-		}
-		else {
-			for (int i = (int)y; i >= 0; i--) {
-				double x_0 = (i - y) / slope + x;
+double Maze::CastRay(double x, double y, double xComponent, double yComponent, RayHit* hit) {
+	// Grid traversal (DDA): step from one cell boundary to the next until a non-path cell is entered,
+	// everything outside the board counts as wall. The direction is expected to be a unit vector
+	int cellX = (int)x;
+	int cellY = (int)y;
 
-				double dist = (x_0 - x) * (x_0 - x) + (y - i) * (y - i);
+	int stepX = xComponent < 0 ? -1 : 1;
+	int stepY = yComponent < 0 ? -1 : 1;
 
-				if ((!CellCheck((int)x_0, i - 1, PathMask) || i == 0) && minimum > dist) minimum = dist;
-			}
-		}
+	double deltaX = xComponent != 0 ? fabs(1 / xComponent) : HUGE_VAL;
+	double deltaY = yComponent != 0 ? fabs(1 / yComponent) : HUGE_VAL;
 
-		if (xComponent > 0) {
-			for (int i = (int)x + 1; i <= width; i++) {
-				double y_0 = (i - x) * slope + y;
+	double sideX = xComponent != 0 ? (xComponent < 0 ? x - cellX : cellX + 1 - x) * deltaX : HUGE_VAL;
+	double sideY = yComponent != 0 ? (yComponent < 0 ? y - cellY : cellY + 1 - y) * deltaY : HUGE_VAL;
 
-				double dist = (i - x) * (i - x) + (y - y_0) * (y - y_0);
+	double dist = 0;
+	int side = 0;
 
-				if (!CellCheck(i, (int)y_0, PathMask) && minimum > dist) minimum = dist;
-			}
+	do {
+		if (sideX < sideY) {
+			dist = sideX;
+			sideX += deltaX;
+			cellX += stepX;
+			side = 0;
 		}
 		else {
-			for (int i = (int)x; i >= 0; i--) {
-				double y_0 = (i - x) * slope + y;
-
-				double dist = (i - x) * (i - x) + (y - y_0) * (y - y_0);
-
-				if ((!CellCheck(i - 1, (int)y_0, PathMask) || i == 0) && minimum > dist) minimum = dist;
-			}
+			dist = sideY;
+			sideY += deltaY;
+			cellY += stepY;
+			side = 1;
 		}
-	}
-	else if (yComponent != 0) {
-		if (yComponent > 0) {
-			for (int i = (int)y + 1; i <= height; i++) {
-				double dist = (y - i) * (y - i);
+	} while (CellCheck(cellX, cellY, PathMask));
 
-				if (!CellCheck(x, i, PathMask) && minimum > dist) minimum = dist;
-			}
-		}
-		else {
-			for (int i = (int)y; i >= 0; i--) {
-				double dist = (y - i) * (y - i);
+	if (hit) {
+		hit->distance = dist;
+		hit->cellX = cellX;
+		hit->cellY = cellY;
+		hit->side = side;
 
-				if ((!CellCheck(x, i - 1, PathMask) || i == 0) && minimum > dist) minimum = dist;
-			}
-		}
+		double along = side == 0 ? y + dist * yComponent : x + dist * xComponent;
+		hit->wallX = along - floor(along);
 	}
-	else {
-		if (xComponent > 0) {
-			for (int i = (int)x + 1; i <= width; i++) {
-				double dist = (i - x) * (i - x);
-
-				if (!CellCheck(i, y, PathMask) && minimum > dist) minimum = dist;
-			}
-		}
-		else {
-			for (int i = (int)x; i >= 0; i--) {
-				double dist = (i - x) * (i - x);
 
-				if ((!CellCheck(i - 1, y, PathMask) || i == 0) && minimum > dist) minimum = dist;
-			}
-		}
-	}
+	return dist;
+}
 
-	return sqrt(minimum);
+const BYTE* Maze::GetBoard() {
+	return board;
 }
 
 double Maze::GetPlayerDirection() {
-	return direction;
+	return player.direction;
 }
@@ -1,61 +1,92 @@
 #pragma once
 
-#include "framework.h"
+#include "core.h"
+#include "physics.h"
+
+struct RayHit {
+	double distance;
+	// The wall cell that stopped the ray, may lie outside the board
+	int cellX;
+	int cellY;
+	// 0 if a vertical (x = const) cell boundary was crossed last, 1 for a horizontal one
+	int side;
+	// Hit position along the wall face, in [0, 1)
+	double wallX;
+};
 
 class Maze {
 public:
 	int width;
 	int height;
 	int iterations;
+	// Seed of the last generation, the same seed and parameters always give the same board
+	unsigned int seed;
+
+	// Bumped whenever a board is complete, either generated or loaded
+	atomic<unsigned int> revision;
+	// False while the generation thread is still carving the board
+	atomic<bool> generated;
+	/*
+	Generate, Load and changes to width and height replace the board. When another thread reads
+	the board meanwhile, both the reader and the thread replacing it hold boardLock
+	*/
+	mutex boardLock;
+
+	// Physics runs in fixed steps of 1 / TickRate seconds so that runs can be replayed
+	static const int TickRate = 240;
 
 	static const BYTE PathMask = 0b00000001;
 	static const BYTE TruePathMask = 0b00000010;
+	// Dead ends the first generation pass backed out of, only set while generating
+	static const BYTE ClosedMask = 0b00000100;
+
+	// Seconds spent by the last generation
+	double generationTime;
+	// The last generation ran out of memory, so its board kept the previous size or is only partly carved
+	bool generationFailed;
 
-	double x;
-	double y;
+	PlayerState<double> player;
 
 	bool keyForward;
 	bool keyBackward;
 	bool keyLeft;
 	bool keyRight;
 
-	Maze(HWND hWnd_);
+	Maze();
 	~Maze();
 
 	void Generate();
-	void Reallocate();
+	void Generate(unsigned int seed);
+	void Wait();
+	bool Save(const string& path);
+	bool Load(const string& path);
+	bool Reallocate();
 	bool CellCheck(int x, int y, BYTE mask);
 	void CellAssign(int x, int y, BYTE mask);
 	void CellRemove(int x, int y, BYTE mask);
 	int PathsAround(int x, int y);
 
-	void PlayerUpdate(double delta, LARGE_INTEGER* timepoint);
+	void PlayerUpdate(double delta);
 	void PlayerReset();
+	unsigned long long StateHash();
 
+	const BYTE* GetBoard();
 	double GetPlayerDirection();
 	double CastRay(double x, double y, double direction);
+	double CastRay(double x, double y, double xComponent, double yComponent, RayHit* hit = nullptr);
 private:
-	HWND hWnd;
-
 	thread generation;
 	bool dying;
 
 	BYTE* board;
+	int boardWidth;
+	int boardHeight;
 
-	vector<pair<int, int>> moves;
-	vector<pair<int, int>> turns;
-	vector<int> directions;
-	unordered_set<long> closedMoves;
-
-	double xVelocity;
-	double yVelocity;
-	double acceleration;
-	double friction;
-
-	double direction;
-	double angularVelocity;
-	double angularAcceleration;
-	double angularFriction;
+	// Generation stacks of cell indices, reserved up front and kept between generations
+	vector<unsigned int> moves;
+	vector<unsigned int> turns;
 
+	bool ReserveArena();
 	void GenerateT();
+	void Carve();
 };
\ No newline at end of file
@@ -0,0 +1,78 @@
+#include "raytable.h"
+
+RayTable::RayTable() :
+	columns(0),
+	fieldOfView(0)
+{}
+
+void RayTable::Update(int columns_, double fieldOfView_) {
+	if (columns == columns_ && fieldOfView == fieldOfView_) return;
+
+	columns = columns_;
+	fieldOfView = fieldOfView_;
+
+	xComponent.resize(columns);
+	yComponent.resize(columns);
+	correction.resize(columns);
+	tangent.resize(columns);
+
+	for (int j = 0; j < columns; j++) {
+		double offset = -fieldOfView / 2 + fieldOfView * j / columns;
+
+		xComponent[j] = cos(offset);
+		yComponent[j] = sin(offset);
+		correction[j] = xComponent[j];
+		tangent[j] = yComponent[j] / xComponent[j];
+	}
+}
+
+int RayTable::Cast(Maze& maze, double x, double y, double forwardX, double forwardY, int stride, vector<RayHit>& hits) const {
+	hits.resize(columns);
+	if (columns == 0) return 0;
+
+	stride = max(stride, 1);
+	int cast = 1;
+	CastColumn(maze, x, y, forwardX, forwardY, 0, hits[0]);
+	for (int left = 0; left < columns - 1; left += stride) {
+		int right = min(left + stride, columns - 1);
+		CastColumn(maze, x, y, forwardX, forwardY, right, hits[right]);
+		cast += 1 + Refine(maze, x, y, forwardX, forwardY, left, right, hits);
+	}
+
+	return cast;
+}
+
+void RayTable::CastColumn(Maze& maze, double x, double y, double forwardX, double forwardY, int column, RayHit& hit) const {
+	double rayX = forwardX * xComponent[column] - forwardY * yComponent[column];
+	double rayY = forwardY * xComponent[column] + forwardX * yComponent[column];
+	maze.CastRay(x, y, rayX, rayY, &hit);
+}
+
+// Fills the columns strictly between left and right, whose hits are known, returns the rays cast
+int RayTable::Refine(Maze& maze, double x, double y, double forwardX, double forwardY, int left, int right, vector<RayHit>& hits) const {
+	if (right - left < 2) return 0;
+
+	const RayHit& a = hits[left];
+	const RayHit& b = hits[right];
+	if (a.cellX != b.cellX || a.cellY != b.cellY || a.side != b.side) {
+		int middle = (left + right) / 2;
+		CastColumn(maze, x, y, forwardX, forwardY, middle, hits[middle]);
+		return 1 + Refine(maze, x, y, forwardX, forwardY, left, middle, hits) + Refine(maze, x, y, forwardX, forwardY, middle, right, hits);
+	}
+
+	// The face is the cell edge facing the player, x = face for side 0 and y = face for side 1
+	double face = a.side == 0 ? (x < a.cellX ? a.cellX : a.cellX + 1) : (y < a.cellY ? a.cellY : a.cellY + 1);
+	for (int j = left + 1; j < right; j++) {
+		double rayX = forwardX * xComponent[j] - forwardY * yComponent[j];
+		double rayY = forwardY * xComponent[j] + forwardX * yComponent[j];
+
+		RayHit& hit = hits[j];
+		hit = a;
+		hit.distance = a.side == 0 ? (face - x) / rayX : (face - y) / rayY;
+
+		double along = a.side == 0 ? y + hit.distance * rayY : x + hit.distance * rayX;
+		hit.wallX = along - floor(along);
+	}
+
+	return 0;
+}
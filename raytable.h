@@ -0,0 +1,36 @@
+#pragma once
+
+#include "core.h"
+#include "maze.h"
+
+class RayTable {
+public:
+	RayTable();
+
+	int columns;
+	double fieldOfView;
+
+	/*
+	Per-column ray offsets from the view direction as unit vectors, plus the
+	fisheye correction factor cos(offset) and tan(offset) for floor casting.
+	Rebuilt only on resize or FOV change
+	*/
+	vector<double> xComponent;
+	vector<double> yComponent;
+	vector<double> correction;
+	vector<double> tangent;
+
+	void Update(int columns, double fieldOfView);
+
+	/*
+	Fills hits with every column's wall hit from x, y facing forwardX, forwardY and returns the
+	number of rays cast. stride 1 casts every column. Larger strides cast every stride-th column
+	and the last, then bisect between neighbouring hits until both lie on the same face of the same
+	cell. A face is one cell long, too short for any wall cell to hide between two rays ending on
+	it, so the columns in between are intersected with its line directly instead of cast
+	*/
+	int Cast(Maze& maze, double x, double y, double forwardX, double forwardY, int stride, vector<RayHit>& hits) const;
+private:
+	void CastColumn(Maze& maze, double x, double y, double forwardX, double forwardY, int column, RayHit& hit) const;
+	int Refine(Maze& maze, double x, double y, double forwardX, double forwardY, int left, int right, vector<RayHit>& hits) const;
+};
@@ -14,16 +14,20 @@ Renderer::Renderer(HWND hWnd_, std::shared_ptr<Maze> maze) :
 	pathBrush(NULL),
 	infoBrush(NULL),
 	whiteBrush(NULL),
-
-	cameraRange(5),
-	wallFrequency(10),
-
-	cellSize(1),
-	gridThickness(1),
-	showPath(false),
-	renderMode(0),
-	infoStrip(true)
+	frameBitmap(NULL),
+	fogBitmap(NULL),
+	fogEpoch(0),
+	fogShowPath(false),
+	mipRevision(0),
+	infoValid(false),
+	frameTime(0),
+	infoTime(0),
+	cacheInfoStrip(true),
+	raysCast(0),
+	rayColumns(0)
 {
+	for (int i = 0; i < InfoLines; i++) infoLayouts[i] = NULL;
+
 	CreateDeviceIndependentResources();
 }
 
@@ -31,6 +35,7 @@ Renderer::~Renderer() {
 	SafeRelease(&factory);
 	SafeRelease(&writeFactory);
 	SafeRelease(&textFormat);
+	for (int i = 0; i < InfoLines; i++) SafeRelease(&infoLayouts[i]);
 	DiscardDeviceResources();
 }
 
@@ -44,10 +49,7 @@ HRESULT Renderer::CreateDeviceResources() {
 	HRESULT hr = S_OK;
 
 	if (!renderTarget) {
-		RECT rect;
-		GetClientRect(hWnd, &rect);
-
-		D2D1_SIZE_U size = D2D1::SizeU(rect.right - rect.left, rect.bottom - rect.top);
+		D2D1_SIZE_U size = D2D1::SizeU(state.width, state.height);
 
 		hr = factory->CreateHwndRenderTarget(D2D1::RenderTargetProperties(), D2D1::HwndRenderTargetProperties(hWnd, size), &renderTarget);
 
@@ -58,11 +60,12 @@ HRESULT Renderer::CreateDeviceResources() {
 		if (SUCCEEDED(hr)) hr = renderTarget->CreateSolidColorBrush(D2D1::ColorF(D2D1::ColorF::DarkSlateGray), &infoBrush);
 		if (SUCCEEDED(hr)) hr = renderTarget->CreateSolidColorBrush(D2D1::ColorF(D2D1::ColorF::White), &whiteBrush);
 
-		if(SUCCEEDED(hr)) {
+		// Text objects don't depend on the device, keep them over a lost one
+		if(SUCCEEDED(hr) && !writeFactory) {
 			hr = DWriteCreateFactory(DWRITE_FACTORY_TYPE_SHARED, __uuidof(writeFactory), reinterpret_cast<IUnknown**>(&writeFactory));
 		}
 
-		if (SUCCEEDED(hr)) {
+		if (SUCCEEDED(hr) && !textFormat) {
 			hr = writeFactory->CreateTextFormat(
 				L"Consolas",
 				NULL,
@@ -92,20 +95,303 @@ void Renderer::DiscardDeviceResources() {
 	SafeRelease(&pathBrush);
 	SafeRelease(&infoBrush);
 	SafeRelease(&whiteBrush);
+	SafeRelease(&frameBitmap);
+	SafeRelease(&fogBitmap);
+}
+
+void Renderer::BuildMips() {
+	mips.clear();
+	mipWidths.clear();
+	mipHeights.clear();
+
+	const BYTE* board = maze->GetBoard();
+	int w = maze->width;
+	int h = maze->height;
+
+	// Level 1 averages 2x2 cells of the board, every further level averages 2x2 texels of the one before
+	for (int level = 1; board && (w > 1 || h > 1); level++) {
+		int mipWidth = (w + 1) / 2;
+		int mipHeight = (h + 1) / 2;
+		vector<BYTE> mip((size_t)mipWidth * mipHeight);
+
+		for (int i = 0; i < mipHeight; i++) {
+			for (int j = 0; j < mipWidth; j++) {
+				// Blocks on an odd last row or column are partial, average only what they cover
+				int sum = 0;
+				int count = 0;
+				for (int k = 0; k < 4; k++) {
+					int sX = 2 * j + (k & 1);
+					int sY = 2 * i + (k >> 1);
+					if (sX >= w || sY >= h) continue;
+					if (level == 1) sum += (board[(size_t)sY * w + sX] & Maze::PathMask) ? 0 : 255;
+					else sum += mips.back()[(size_t)sY * w + sX];
+					count++;
+				}
+				mip[(size_t)i * mipWidth + j] = sum / count;
+			}
+		}
+
+		mips.push_back(move(mip));
+		mipWidths.push_back(mipWidth);
+		mipHeights.push_back(mipHeight);
+		w = mipWidth;
+		h = mipHeight;
+	}
+
+	mipRevision = maze->revision;
+}
+
+bool Renderer::RenderOverview(UINT width, UINT height, float pitch) {
+	// Without a board there is nothing to sample, leave the cleared target as it is
+	const BYTE* board = maze->GetBoard();
+	if (!board) return false;
+
+	frame.resize((size_t)width * height);
+	if (maze->generated && mipRevision != maze->revision) BuildMips();
+
+	// One sample per pixel, from the mip level whose texels are about a pixel wide
+	const float cellsPerPixel = 1 / (pitch * state.viewScale);
+	int level = 0;
+	while (level < (int)mips.size() && (float)(2 << level) <= cellsPerPixel) level++;
+
+	// Mips of a board that is still being generated don't exist yet, sample the board itself
+	if (!maze->generated || mipRevision != maze->revision) level = 0;
+
+	columnCells.resize(width);
+	for (UINT j = 0; j < width; j++) columnCells[j] = min((int)((state.viewX + (j + 0.5f) / state.viewScale) / pitch), maze->width - 1);
+
+	for (UINT i = 0; i < height; i++) {
+		int row = min((int)((state.viewY + (i + 0.5f) / state.viewScale) / pitch), maze->height - 1);
+		UINT32* out = &frame[(size_t)i * width];
+
+		if (level == 0) {
+			const BYTE* cells = board + (size_t)row * maze->width;
+			for (UINT j = 0; j < width; j++) {
+				BYTE cell = cells[columnCells[j]];
+				out[j] = !(cell & Maze::PathMask) ? 0xFF32CD32 : (state.showPath && (cell & Maze::TruePathMask)) ? 0xFF0000FF : 0xFF000000;
+			}
+		}
+		else {
+			const vector<BYTE>& mip = mips[level - 1];
+			const BYTE* texels = &mip[(size_t)(row >> level) * mipWidths[level - 1]];
+			for (UINT j = 0; j < width; j++) out[j] = Shade(0xFF32CD32, texels[columnCells[j] >> level]);
+		}
+	}
+
+	return true;
+}
+
+UINT32 Renderer::FogColor(int cell, bool lit) {
+	BYTE value = maze->GetBoard()[cell];
+	UINT32 color = cell == maze->width * maze->height - 1 ? 0xFFFFFFFF : !(value & Maze::PathMask) ? 0xFF32CD32 : (state.showPath && (value & Maze::TruePathMask)) ? 0xFF0000FF : 0xFF383838;
+	return lit ? color : Shade(color, 80);
+}
+
+HRESULT Renderer::RenderFog(float pitch) {
+	HRESULT hr = S_OK;
+
+	const int width = maze->width;
+	const int height = maze->height;
+	if (!maze->GetBoard()) return hr;
+
+	bool changed = visibility.Compute(*maze, (int)state.playerX, (int)state.playerY, state.cameraRange);
+
+	UINT32 maxSize = renderTarget->GetMaximumBitmapSize();
+	if ((UINT32)width > maxSize || (UINT32)height > maxSize) {
+		// Too large for one bitmap, show only the walls in view
+		for (int cell : visibility.visible) {
+			if (maze->GetBoard()[cell] & Maze::PathMask) continue;
+			D2D1_RECT_F rect = D2D1::RectF(pitch * (cell % width), pitch * (cell / width), pitch * (cell % width + 1), pitch * (cell / width + 1));
+			renderTarget->FillRectangle(rect, cellBrush);
+		}
+		return hr;
+	}
+
+	// A new board, a lost device or the path switching on or off repaints every explored cell
+	if (fogImage.size() != (size_t)width * height || !fogBitmap || fogEpoch != visibility.epoch || fogShowPath != state.showPath) {
+		fogEpoch = visibility.epoch;
+		fogShowPath = state.showPath;
+		fogImage.assign((size_t)width * height, 0xFF000000);
+		for (int i = 0; i < height; i++) {
+			for (int j = 0; j < width; j++) {
+				if (visibility.Explored(j, i)) fogImage[(size_t)i * width + j] = FogColor(i * width + j, false);
+			}
+		}
+		fogVisible.clear();
+		SafeRelease(&fogBitmap);
+		changed = true;
+	}
+
+	// Otherwise only the cells that left or entered the view change, and only their bounding box is uploaded
+	int left = width;
+	int top = height;
+	int right = -1;
+	int bottom = -1;
+	if (changed) {
+		auto paint = [&](int cell, bool lit) {
+			fogImage[cell] = FogColor(cell, lit);
+			left = min(left, cell % width);
+			right = max(right, cell % width);
+			top = min(top, cell / width);
+			bottom = max(bottom, cell / width);
+		};
+		for (int cell : fogVisible) paint(cell, false);
+		for (int cell : visibility.visible) paint(cell, true);
+		fogVisible = visibility.visible;
+	}
+
+	if (!fogBitmap) {
+		hr = renderTarget->CreateBitmap(D2D1::SizeU(width, height), fogImage.data(), width * sizeof(UINT32),
+			D2D1::BitmapProperties(D2D1::PixelFormat(DXGI_FORMAT_B8G8R8A8_UNORM, D2D1_ALPHA_MODE_IGNORE)), &fogBitmap);
+	}
+	else if (right >= 0) {
+		D2D1_RECT_U dirty = D2D1::RectU(left, top, right + 1, bottom + 1);
+		hr = fogBitmap->CopyFromMemory(&dirty, &fogImage[(size_t)top * width + left], width * sizeof(UINT32));
+	}
+
+	if (SUCCEEDED(hr)) renderTarget->DrawBitmap(fogBitmap, D2D1::RectF(0, 0, width * pitch, height * pitch), 1.0f, D2D1_BITMAP_INTERPOLATION_MODE_NEAREST_NEIGHBOR);
+
+	return hr;
+}
+
+bool Renderer::InfoKey::operator==(const InfoKey& other) const {
+	return renderMode == other.renderMode && iterations == other.iterations && mazeWidth == other.mazeWidth && mazeHeight == other.mazeHeight
+		&& cameraRange == other.cameraRange && wallFrequency == other.wallFrequency && rayStride == other.rayStride && width == other.width;
+}
+
+void Renderer::BuildInfoLayouts(const InfoKey& key) {
+	for (int i = 0; i < InfoLines; i++) SafeRelease(&infoLayouts[i]);
+
+	wstring lines[InfoLines];
+	lines[0] = L"Maze mode: 2D view and gameplay [M to change]";
+	lines[1] = L"Maze size: " + to_wstring(key.mazeWidth) + L"x" + to_wstring(key.mazeHeight) + L" [+, -, =, _ to adjust]";
+	lines[2] = L"Iteration count: " + to_wstring(key.iterations) + L" [F, G to adjust]";
+	lines[3] = L"W, A, S, D to move, Enter to generate a new maze";
+	lines[4] = L"C to highlight the path, H to switch the info strip";
+	if (key.renderMode == 1) lines[0] = L"Maze mode: 2D view, 3D gameplay [M to change]";
+	else if (key.renderMode == 2) {
+		lines[0] = L"Maze mode: 3D view and gameplay [M to change]";
+		lines[4] = L"Camera range: " + to_wstring(key.cameraRange) + L" blocks [E, R to adjust]";
+		lines[5] = L"Wall strip frequency: " + to_wstring(key.wallFrequency) + L" strips [T, Y to adjust]";
+		lines[6] = (key.rayStride > 1 ? L"Adaptive ray sampling" : L"A ray per column") + wstring(L" [Z to switch], H to switch the info strip");
+	}
+
+	for (int i = 0; i < InfoLines; i++) {
+		if (!lines[i].empty()) writeFactory->CreateTextLayout(lines[i].c_str(), (UINT32)lines[i].length(), textFormat, max(key.width - 2, 0.0f), InfoLineHeight, &infoLayouts[i]);
+	}
+
+	infoKey = key;
+	infoValid = true;
+}
+
+void Renderer::DrawInfoStrip(float width, float height) {
+	D2D1_RECT_F rectangle;
+	rectangle.left = 0;
+	rectangle.right = width;
+	rectangle.bottom = height;
+	rectangle.top = rectangle.bottom - (state.renderMode != 2 ? 98 : 136);
+	renderTarget->FillRectangle(rectangle, infoBrush);
+
+	// Shaping happens once per change of the values shown, steady frames only draw the cached layouts
+	InfoKey key = { state.renderMode, state.iterations, maze->width, maze->height, state.cameraRange, state.wallFrequency, state.rayStride, width };
+	if (!cacheInfoStrip || !infoValid || !(key == infoKey)) BuildInfoLayouts(key);
+
+	for (int i = 0; i < InfoLines; i++) {
+		if (infoLayouts[i]) renderTarget->DrawTextLayout(D2D1::Point2F(2, rectangle.top + InfoLineHeight * i), infoLayouts[i], whiteBrush);
+	}
+}
+
+HRESULT Renderer::PresentFrame(UINT width, UINT height) {
+	HRESULT hr = S_OK;
+
+	if (frameBitmap && (frameBitmap->GetPixelSize().width != width || frameBitmap->GetPixelSize().height != height)) SafeRelease(&frameBitmap);
+
+	if (!frameBitmap) {
+		hr = renderTarget->CreateBitmap(D2D1::SizeU(width, height), NULL, 0,
+			D2D1::BitmapProperties(D2D1::PixelFormat(DXGI_FORMAT_B8G8R8A8_UNORM, D2D1_ALPHA_MODE_IGNORE)), &frameBitmap);
+	}
+
+	if (SUCCEEDED(hr)) hr = frameBitmap->CopyFromMemory(NULL, frame.data(), width * sizeof(UINT32));
+	if (SUCCEEDED(hr)) renderTarget->DrawBitmap(frameBitmap, D2D1::RectF(0, 0, width, height), 1.0f, D2D1_BITMAP_INTERPOLATION_MODE_NEAREST_NEIGHBOR);
+
+	return hr;
+}
+
+Frame::Frame() :
+	renderMode(0),
+	infoStrip(true),
+	cellSize(1),
+	gridThickness(1),
+	showPath(false),
+	wallFrequency(10),
+	cameraRange(5),
+	fieldOfView(PI / 2),
+	rayStride(8),
+	viewScale(1),
+	viewX(0),
+	viewY(0),
+	width(1),
+	height(1),
+	playerX(0.5),
+	playerY(0.5),
+	playerDirection(0),
+	iterations(0),
+	inputTime(0)
+{}
+
+void Frame::ResetView() {
+	viewScale = 1;
+	viewX = 0;
+	viewY = 0;
+}
+
+void Frame::Zoom(float factor, float x, float y) {
+	// Keep the maze point under (x, y) in place
+	float anchorX = viewX + x / viewScale;
+	float anchorY = viewY + y / viewScale;
+
+	viewScale = min(max(viewScale * factor, 1.0f), MaxViewScale);
+	viewX = anchorX - x / viewScale;
+	viewY = anchorY - y / viewScale;
+}
+
+void Frame::Pan(float dx, float dy) {
+	viewX -= dx / viewScale;
+	viewY -= dy / viewScale;
+}
+
+void Frame::ClampView(int mazeWidth, int mazeHeight) {
+	// Keep the camera over the maze
+	const float pitch = cellSize + gridThickness;
+	const float viewHeight = (float)max((int)height - (infoStrip ? 98 : 0), 0);
+
+	viewScale = min(max(viewScale, 1.0f), MaxViewScale);
+	viewX = min(max(viewX, 0.0f), max(mazeWidth * pitch - width / viewScale, 0.0f));
+	viewY = min(max(viewY, 0.0f), max(mazeHeight * pitch - viewHeight / viewScale, 0.0f));
 }
 
 void Renderer::Resize(UINT width, UINT height) {
 	if (renderTarget) {
 		renderTarget->Resize(D2D1::SizeU(width, height));
 	}
+	SafeRelease(&frameBitmap);
 }
 
-HRESULT Renderer::Render() {
+HRESULT Renderer::Render(const Frame& next) {
 	HRESULT hr = S_OK;
+	auto t1 = chrono::steady_clock::now();
+
+	// The target follows the client area the simulation thread laid out
+	bool resized = next.width != state.width || next.height != state.height;
+	state = next;
+	if (resized) Resize(state.width, state.height);
 
 	hr = CreateDeviceResources();
 
 	if (SUCCEEDED(hr)) {
+		// Generate replaces the board under this lock, hold it for as long as the frame reads the board
+		unique_lock<mutex> lock(maze->boardLock);
+
 		renderTarget->BeginDraw();
 
 		renderTarget->Clear(D2D1::ColorF(D2D1::ColorF::Black));
@@ -113,134 +399,126 @@ HRESULT Renderer::Render() {
 		const float width = renderTarget->GetSize().width;
 		const float height = renderTarget->GetSize().height;
 
-		if (renderMode == 0 || renderMode == 1) {
-			if (renderMode == 0) {
-				D2D1_RECT_F rect;
-				rect.left = (cellSize + gridThickness) * (maze->width - 1);
-				rect.right = (cellSize + gridThickness) * maze->width - gridThickness;
-				rect.top = (cellSize + gridThickness) * (maze->height - 1);
-				rect.bottom = (cellSize + gridThickness) * maze->height - gridThickness;
-				renderTarget->DrawRectangle(rect, whiteBrush, gridThickness);
+		// The camera basis is the only trigonometry per frame, rays come from the precomputed table
+		rays.Update((int)width, state.fieldOfView);
+		const double forwardX = cos(state.playerDirection);
+		const double forwardY = sin(state.playerDirection);
+		raysCast = 0;
+		rayColumns = 0;
+
+		if (state.renderMode == 0 || state.renderMode == 1) {
+			const float pitch = state.cellSize + state.gridThickness;
+			const UINT viewWidth = (UINT)width;
+			const UINT viewHeight = max((int)height - (state.infoStrip ? 98 : 0), 0);
+
+			// Keep the camera over the maze, then cull to the cells it can see
+			state.ClampView(maze->width, maze->height);
+
+			const int firstColumn = max((int)(state.viewX / pitch), 0);
+			const int lastColumn = min((int)((state.viewX + viewWidth / state.viewScale) / pitch) + 1, maze->width);
+			const int firstRow = max((int)(state.viewY / pitch), 0);
+			const int lastRow = min((int)((state.viewY + viewHeight / state.viewScale) / pitch) + 1, maze->height);
+
+			const D2D1::Matrix3x2F camera = D2D1::Matrix3x2F::Translation(-state.viewX, -state.viewY) * D2D1::Matrix3x2F::Scale(state.viewScale, state.viewScale);
+
+			if (state.renderMode == 0 && pitch * state.viewScale < LodPixels) {
+				// Too many cells per pixel for one rectangle each, draw a sampled overview instead
+				if (RenderOverview(viewWidth, viewHeight, pitch)) hr = PresentFrame(viewWidth, viewHeight);
 			}
+			else if (state.renderMode == 1) {
+				renderTarget->SetTransform(camera);
+				hr = RenderFog(pitch);
+			}
+			else {
+				renderTarget->SetTransform(camera);
+
+				for (int i = firstRow; i < lastRow; i++) {
+					for (int j = firstColumn; j < lastColumn; j++) {
+						D2D1_RECT_F rect;
+						rect.left = pitch * j;
+						rect.right = pitch * (j + 1);
+						rect.top = pitch * i;
+						rect.bottom = pitch * (i + 1);
+						if (j == (int)state.playerX && i == (int)state.playerY && state.renderMode == 0) renderTarget->FillRectangle(rect, playerBrush);
+						else if (state.showPath && maze->CellCheck(j, i, Maze::TruePathMask)) renderTarget->FillRectangle(rect, pathBrush);
+						if (!maze->CellCheck(j, i, Maze::PathMask) && state.renderMode == 0) renderTarget->FillRectangle(rect, cellBrush);
+					}
+				}
 
-			for (int i = 0; i < maze->height; i++) {
-				for (int j = 0; j < maze->width; j++) {
-					D2D1_RECT_F rect;
-					rect.left = (cellSize + gridThickness) * j;
-					rect.right = (cellSize + gridThickness) * (j + 1);
-					rect.top = (cellSize + gridThickness) * i;
-					rect.bottom = (cellSize + gridThickness) * (i + 1);
-					if (j == (int)maze->x && i == (int)maze->y && renderMode == 0) renderTarget->FillRectangle(rect, playerBrush);
-					else if (showPath && maze->CellCheck(j, i, Maze::TruePathMask)) renderTarget->FillRectangle(rect, pathBrush);
-					if (!maze->CellCheck(j, i, Maze::PathMask) && renderMode == 0) renderTarget->FillRectangle(rect, cellBrush);
+				if (state.renderMode == 0) {
+					for (int i = firstColumn; i < lastColumn; i++) {
+						D2D1_RECT_F rect;
+						rect.left = pitch * (i + 1) - state.gridThickness;
+						rect.right = pitch * (i + 1);
+						rect.top = pitch * firstRow;
+						rect.bottom = pitch * lastRow;
+						renderTarget->FillRectangle(rect, gridBrush);
+					}
+
+					for (int i = firstRow; i < lastRow; i++) {
+						D2D1_RECT_F rect;
+						rect.left = pitch * firstColumn;
+						rect.right = pitch * lastColumn;
+						rect.top = pitch * (i + 1) - state.gridThickness;
+						rect.bottom = pitch * (i + 1);
+						renderTarget->FillRectangle(rect, gridBrush);
+					}
 				}
 			}
 
-			if (renderMode == 0) {
-				for (int i = 0; i < maze->width; i++) {
-					D2D1_RECT_F rect;
-					rect.left = (cellSize + gridThickness) * (i + 1) - gridThickness;
-					rect.right = (cellSize + gridThickness) * (i + 1);
-					rect.top = 0;
-					rect.bottom = height - (infoStrip ? 98 : 0);
-					renderTarget->FillRectangle(rect, gridBrush);
-				}
+			renderTarget->SetTransform(camera);
 
-				for (int i = 0; i < maze->height; i++) {
-					D2D1_RECT_F rect;
-					rect.left = 0;
-					rect.right = width;
-					rect.top = (cellSize + gridThickness) * (i + 1) - gridThickness;
-					rect.bottom = (cellSize + gridThickness) * (i + 1);
-					renderTarget->FillRectangle(rect, gridBrush);
+			if (state.renderMode == 0) {
+				D2D1_RECT_F rect;
+				rect.left = pitch * (maze->width - 1);
+				rect.right = pitch * maze->width - state.gridThickness;
+				rect.top = pitch * (maze->height - 1);
+				rect.bottom = pitch * maze->height - state.gridThickness;
+				renderTarget->DrawRectangle(rect, whiteBrush, max(state.gridThickness, 1 / state.viewScale));
+
+				if (pitch * state.viewScale < LodPixels) {
+					// Keep the player visible at any zoom level
+					float size = max(pitch, 2 / state.viewScale);
+					renderTarget->FillRectangle(D2D1::RectF((int)state.playerX * pitch, (int)state.playerY * pitch, (int)state.playerX * pitch + size, (int)state.playerY * pitch + size), playerBrush);
 				}
 			}
 			else {
 				D2D1_ELLIPSE point{};
-				point.point = D2D1::Point2F(maze->x * (cellSize + gridThickness), maze->y * (cellSize + gridThickness));
-				point.radiusX = cellSize / 10.0f;
-				point.radiusY = cellSize / 10.0f;
+				point.point = D2D1::Point2F(state.playerX * pitch, state.playerY * pitch);
+				point.radiusX = state.cellSize / 10.0f;
+				point.radiusY = state.cellSize / 10.0f;
 				renderTarget->FillEllipse(point, playerBrush);
 
-				for (double i = maze->GetPlayerDirection() - PI / 4; i <= maze->GetPlayerDirection() + PI / 4; i += PI / (2 * width)) {
-					double dist = maze->CastRay(maze->x, maze->y, i);
-
-					D2D1_ELLIPSE wallPoint{};
-					wallPoint.point = D2D1::Point2F(point.point.x + cos(i) * dist * (cellSize + gridThickness), point.point.y + sin(i) * dist * (cellSize + gridThickness));
-					wallPoint.radiusX = 1;
-					wallPoint.radiusY = 1;
-
-					if (wallPoint.point.x >= width - 1) wallPoint.point.x--;
-
-					D2D1_POINT_2F wallPointNotScaled = D2D1::Point2F(maze->x + cos(i) * dist, maze->y + sin(i) * dist);
-
-					ID2D1SolidColorBrush* brush;
-					hr = renderTarget->CreateSolidColorBrush(D2D1::ColorF(
-						(wallPointNotScaled.x >= maze->width - 1) && (wallPointNotScaled.y >= maze->height - 1) ? 1 : 0,
-						1, (wallPointNotScaled.x >= maze->width - 1) && (wallPointNotScaled.y >= maze->height - 1) ? 1 : 0,
-						1 - min(dist * cos(i - maze->GetPlayerDirection()), cameraRange) / cameraRange), &brush);
-
-					renderTarget->DrawLine(point.point, wallPoint.point, whiteBrush, 0.01f);					
-
-					if (brush) renderTarget->FillEllipse(wallPoint, brush);
-					SafeRelease(&brush);
-				}
+				// The fog map shows what can be seen, the heading shows where the player looks
+				D2D1_POINT_2F heading = D2D1::Point2F(point.point.x + forwardX * pitch / 2, point.point.y + forwardY * pitch / 2);
+				renderTarget->DrawLine(point.point, heading, playerBrush, state.cellSize / 20.0f);
 			}
+
+			renderTarget->SetTransform(D2D1::Matrix3x2F::Identity());
 		}
 		else {
-			int j = 0;
-
-			for (double i = maze->GetPlayerDirection() - PI / 4; i < maze->GetPlayerDirection() + PI / 4; i += PI / (2 * width)) {
-				double dist = maze->CastRay(maze->x, maze->y, i);
-
-				D2D1_POINT_2F point = D2D1::Point2F(maze->x + cos(i) * dist, maze->y + sin(i) * dist);
-
-				ID2D1SolidColorBrush* brush;
-				hr = renderTarget->CreateSolidColorBrush(D2D1::ColorF(
-					(point.x >= maze->width - 1) && (point.y >= maze->height - 1) ? 1 : (((int)(wallFrequency * point.x) + (int)(wallFrequency * point.y)) % 2) / 1.5,
-					1, (point.x >= maze->width - 1) && (point.y >= maze->height - 1) ? 1 : 0, 
-					1 - min(dist * cos(i - maze->GetPlayerDirection()), cameraRange) / cameraRange), &brush);
-
-				if(brush) renderTarget->DrawLine(D2D1::Point2F(j, 0), D2D1::Point2F(j, height), brush, 1.0f);
-				SafeRelease(&brush);
-
-				j++;
+			const UINT viewWidth = rays.columns;
+			const UINT viewHeight = max((int)height - (state.infoStrip ? 136 : 0), 0);
+
+			if (viewWidth > 0 && viewHeight > 0) {
+				scene.wallFrequency = state.wallFrequency;
+				scene.cameraRange = state.cameraRange;
+				scene.rayStride = state.rayStride;
+				raysCast = scene.Render(*maze, rays, viewHeight, state.playerX, state.playerY, forwardX, forwardY, frame);
+				rayColumns = viewWidth;
+				hr = PresentFrame(viewWidth, viewHeight);
 			}
 		}
 
-		if (infoStrip) {
-			D2D1_RECT_F rectangle;
-			rectangle.left = 0;
-			rectangle.right = width;
-			rectangle.bottom = height;
-			rectangle.top = rectangle.bottom - (renderMode != 2 ? 98 : 136);
-			renderTarget->FillRectangle(rectangle, infoBrush);
-
-			wstring out5 = L"C to highlight the path, H to switch the info strip";
-			wstring out4 = L"W, A, S, D to move, Enter to generate a new maze";
-			wstring out3 = L"Iteration count: " + to_wstring(maze->iterations) + L" [F, G to adjust]";
-			wstring out2 = L"Maze size: " + to_wstring(maze->width) + L"x" + to_wstring(maze->height) + L" [+, -, =, _ to adjust]";
-			wstring out1 = L"Maze mode: 2D view and gameplay [M to change]";
-			if (renderMode == 1) out1 = L"Maze mode: 2D view, 3D gameplay [M to change]";
-			else if (renderMode == 2) {
-				out1 = L"Maze mode: 3D view and gameplay [M to change]";
-				out5 = L"Camera range: " + to_wstring(cameraRange) + L" blocks [E, R to adjust]";
-			}
-
-			renderTarget->DrawText(out1.c_str(), out1.length(), textFormat, D2D1::RectF(2, rectangle.top, width, height), whiteBrush);
-			renderTarget->DrawText(out2.c_str(), out2.length(), textFormat, D2D1::RectF(2, rectangle.top + 19, width, height), whiteBrush);
-			renderTarget->DrawText(out3.c_str(), out3.length(), textFormat, D2D1::RectF(2, rectangle.top + 38, width, height), whiteBrush);
-			renderTarget->DrawText(out4.c_str(), out4.length(), textFormat, D2D1::RectF(2, rectangle.top + 57, width, height), whiteBrush);
-			renderTarget->DrawText(out5.c_str(), out5.length(), textFormat, D2D1::RectF(2, rectangle.top + 76, width, height), whiteBrush);
-
-			if (renderMode == 2) {
-				wstring out7 = L"H to switch the info strip";
-				wstring out6 = L"Wall strip frequency: " + to_wstring(wallFrequency) + L" strips [T, Y to adjust]";
-				renderTarget->DrawText(out6.c_str(), out6.length(), textFormat, D2D1::RectF(2, rectangle.top + 95, width, height), whiteBrush);
-				renderTarget->DrawText(out7.c_str(), out7.length(), textFormat, D2D1::RectF(2, rectangle.top + 114, width, height), whiteBrush);
-			}
+		if (state.infoStrip) {
+			auto t2 = chrono::steady_clock::now();
+			DrawInfoStrip(width, height);
+			infoTime = chrono::duration<double>(chrono::steady_clock::now() - t2).count();
 		}
-		
+		else infoTime = 0;
+
+		lock.unlock();
+		frameTime = chrono::duration<double>(chrono::steady_clock::now() - t1).count();
 		renderTarget->EndDraw();
 
 		if (hr == D2DERR_RECREATE_TARGET) {
@@ -2,13 +2,15 @@
 
 #include "framework.h"
 #include "maze.h"
+#include "raytable.h"
+#include "scene.h"
+#include "fov.h"
 
-class Renderer {
-public:
-	Renderer(HWND hWnd_, std::shared_ptr<Maze> maze);
-	~Renderer();
-
-	std::shared_ptr<Maze> maze;
+/*
+Everything a frame depends on apart from the board. The simulation thread owns one, changes it
+as input arrives and hands copies to the render thread, which never writes back
+*/
+struct Frame {
 	/*
 	renderMode = 0: 2D rendering, 2D gameplay
 	renderMode = 1: 2D rendering, 3D gameplay
@@ -23,15 +25,131 @@ public:
 
 	int wallFrequency;
 	int cameraRange;
+	double fieldOfView;
+	// Mode 2 casts every rayStride-th column and refines between them, 1 casts a ray per column
+	int rayStride;
 
-	HRESULT Render();
-	void Resize(UINT width, UINT height);
+	/*
+	2D camera in window pixels: the fitted layout is scaled by viewScale (1 shows the whole maze)
+	and viewX, viewY is its top left corner in unscaled layout pixels
+	*/
+	float viewScale;
+	float viewX;
+	float viewY;
+	static constexpr float MaxViewScale = 1024;
+
+	// Client area, the render target follows it
+	UINT width;
+	UINT height;
+
+	// Player and maze state when the frame was taken
+	double playerX;
+	double playerY;
+	double playerDirection;
+	int iterations;
+
+	// QueryPerformanceCounter time of the oldest input this frame is the first to show, 0 if none
+	LONGLONG inputTime;
+
+	Frame();
+
+	void ResetView();
+	void Zoom(float factor, float x, float y);
+	void Pan(float dx, float dy);
+	void ClampView(int mazeWidth, int mazeHeight);
+};
+
+class Renderer {
+public:
+	Renderer(HWND hWnd_, std::shared_ptr<Maze> maze);
+	~Renderer();
+
+	std::shared_ptr<Maze> maze;
+
+	// Seconds the last Render spent drawing, not counting the wait for the vertical blank in EndDraw
+	double frameTime;
+	// Seconds of frameTime spent on the info strip
+	double infoTime;
+	// False rebuilds the info strip text every frame, to compare against the cached layouts
+	bool cacheInfoStrip;
+	// Rays the last Render cast for mode 2 and the columns they covered, both 0 in the other modes
+	int raysCast;
+	int rayColumns;
+
+	// Draws and presents one frame, only ever called from the render thread
+	HRESULT Render(const Frame& next);
 private:
 	HRESULT CreateDeviceIndependentResources();
 	HRESULT CreateDeviceResources();
 	void DiscardDeviceResources();
 
 	HWND hWnd;
+	RayTable rays;
+
+	// The frame being drawn
+	Frame state;
+
+	void Resize(UINT width, UINT height);
+
+	// Mode 2 and the mode 0 overview draw into a software framebuffer that is uploaded as one bitmap per frame
+	vector<UINT32> frame;
+	Scene scene;
+
+	/*
+	Below LodPixels screen pixels per cell mode 0 stops drawing rectangles and samples one
+	cell or occupancy mip texel per pixel instead. mips[k] averages 2^(k + 1) x 2^(k + 1) cells
+	and is rebuilt once per maze revision
+	*/
+	static constexpr float LodPixels = 4;
+	vector<vector<BYTE>> mips;
+	vector<int> mipWidths;
+	vector<int> mipHeights;
+	unsigned int mipRevision;
+	vector<int> columnCells;
+
+	/*
+	Mode 1 draws a fog-of-war map with one texel per cell: black until the player has seen a cell,
+	dimmed once it is out of view. Only the cells entering or leaving the field of view are repainted
+	*/
+	FieldOfView visibility;
+	vector<UINT32> fogImage;
+	vector<int> fogVisible;
+	unsigned int fogEpoch;
+	bool fogShowPath;
+
+	UINT32 FogColor(int cell, bool lit);
+	HRESULT RenderFog(float pitch);
+
+	/*
+	Info strip lines as DirectWrite layouts, built from the values in infoKey and rebuilt only
+	when one of them changes, so steady frames build no strings and shape no text
+	*/
+	struct InfoKey {
+		int renderMode;
+		int iterations;
+		int mazeWidth;
+		int mazeHeight;
+		int cameraRange;
+		int wallFrequency;
+		int rayStride;
+		float width;
+
+		bool operator==(const InfoKey& other) const;
+	};
+	static const int InfoLines = 7;
+	static constexpr float InfoLineHeight = 19;
+	IDWriteTextLayout* infoLayouts[InfoLines];
+	InfoKey infoKey;
+	bool infoValid;
+
+	void BuildInfoLayouts(const InfoKey& key);
+	void DrawInfoStrip(float width, float height);
+
+	void BuildMips();
+	// False when there is no board to draw, frame is left untouched then
+	bool RenderOverview(UINT width, UINT height, float pitch);
+	HRESULT PresentFrame(UINT width, UINT height);
+
 	ID2D1Factory* factory;
 	ID2D1HwndRenderTarget* renderTarget;
 
@@ -44,4 +162,7 @@ private:
 	ID2D1SolidColorBrush* pathBrush;
 	ID2D1SolidColorBrush* infoBrush;
 	ID2D1SolidColorBrush* whiteBrush;
+
+	ID2D1Bitmap* frameBitmap;
+	ID2D1Bitmap* fogBitmap;
 };
\ No newline at end of file
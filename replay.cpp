@@ -0,0 +1,197 @@
+#include "replay.h"
+
+using namespace ReplayFormat;
+
+template <typename T> void WriteValue(ofstream& file, T value) {
+	for (size_t i = 0; i < sizeof(T); i++) file.put((char)((unsigned long long)value >> (8 * i)));
+}
+
+template <typename T> bool ReadValue(ifstream& file, T& value) {
+	unsigned long long raw = 0;
+	for (size_t i = 0; i < sizeof(T); i++) {
+		int c = file.get();
+		if (c == EOF) return false;
+		raw |= (unsigned long long)(BYTE)c << (8 * i);
+	}
+	value = (T)raw;
+	return true;
+}
+
+void WriteVarint(ofstream& file, unsigned int value) {
+	while (value >= 0x80) {
+		file.put((char)(value | 0x80));
+		value >>= 7;
+	}
+	file.put((char)value);
+}
+
+bool ReadVarint(ifstream& file, unsigned int& value) {
+	value = 0;
+	for (int shift = 0; shift < 35; shift += 7) {
+		int c = file.get();
+		if (c == EOF) return false;
+		value |= (unsigned int)(c & 0x7F) << shift;
+		if (!(c & 0x80)) return true;
+	}
+	return false;
+}
+
+BYTE KeyState(Maze* maze) {
+	return (maze->keyForward ? KeyForward : 0) | (maze->keyBackward ? KeyBackward : 0) | (maze->keyLeft ? KeyLeft : 0) | (maze->keyRight ? KeyRight : 0);
+}
+
+void SetKeyState(Maze* maze, BYTE keys) {
+	maze->keyForward = keys & KeyForward;
+	maze->keyBackward = keys & KeyBackward;
+	maze->keyLeft = keys & KeyLeft;
+	maze->keyRight = keys & KeyRight;
+}
+
+Recorder::Recorder(std::shared_ptr<Maze> maze) :
+	maze(maze),
+	tick(0),
+	lastEventTick(0),
+	lastKeys(0)
+{}
+
+Recorder::~Recorder() {
+	Close();
+}
+
+bool Recorder::Open(const string& path, int renderMode) {
+	Close();
+
+	lock_guard<mutex> guard(lock);
+	file.open(path, ios::binary | ios::trunc);
+	if (!file) return false;
+
+	file.write("MZRP", 4);
+	WriteValue<unsigned short>(file, Version);
+	WriteValue<unsigned short>(file, Maze::TickRate);
+	WriteValue<unsigned int>(file, maze->seed);
+	WriteValue<int>(file, maze->width);
+	WriteValue<int>(file, maze->height);
+	WriteValue<int>(file, maze->iterations);
+	WriteValue<BYTE>(file, renderMode);
+
+	tick = 0;
+	lastEventTick = 0;
+	lastKeys = 0;
+
+	return (bool)file;
+}
+
+void Recorder::Tick(bool reset) {
+	lock_guard<mutex> guard(lock);
+	if (!file.is_open()) return;
+
+	BYTE keys = KeyState(maze.get());
+	if (keys != lastKeys || reset) {
+		WriteVarint(file, tick - lastEventTick);
+		file.put((char)(keys | (reset ? KeyReset : 0)));
+		lastEventTick = tick;
+		lastKeys = keys;
+	}
+
+	tick++;
+}
+
+bool Recorder::Close() {
+	lock_guard<mutex> guard(lock);
+	if (!file.is_open()) return false;
+
+	WriteVarint(file, tick - lastEventTick);
+	file.put((char)EventEnd);
+	WriteValue<unsigned long long>(file, maze->StateHash());
+
+	bool ok = (bool)file;
+	file.close();
+
+	return ok;
+}
+
+bool Recorder::Recording() {
+	lock_guard<mutex> guard(lock);
+	return file.is_open();
+}
+
+Replayer::Replayer(std::shared_ptr<Maze> maze) :
+	tickRate(Maze::TickRate),
+	renderMode(1),
+	expectedHash(0),
+	maze(maze),
+	next(0),
+	tick(0),
+	endTick(0)
+{}
+
+bool Replayer::Open(const string& path) {
+	ifstream file(path, ios::binary);
+	if (!file) return false;
+
+	char magic[4];
+	unsigned short version;
+	unsigned short rate;
+	unsigned int seed;
+	int width;
+	int height;
+	int iterations;
+	BYTE mode;
+
+	if (!file.read(magic, 4) || memcmp(magic, "MZRP", 4) != 0) return false;
+	if (!ReadValue(file, version) || version != Version) return false;
+	if (!ReadValue(file, rate) || !ReadValue(file, seed) || !ReadValue(file, width) || !ReadValue(file, height) ||
+		!ReadValue(file, iterations) || !ReadValue(file, mode)) return false;
+	if (rate == 0 || width < 1 || height < 1 || iterations < 0) return false;
+
+	events.clear();
+	unsigned int at = 0;
+	while (true) {
+		unsigned int delta;
+		int keys;
+		if (!ReadVarint(file, delta) || (keys = file.get()) == EOF) return false;
+		at += delta;
+		if (keys == EventEnd) break;
+		events.push_back({ at, (BYTE)keys });
+	}
+	if (!ReadValue(file, expectedHash)) return false;
+
+	tickRate = rate;
+	renderMode = mode;
+	endTick = at;
+	next = 0;
+	tick = 0;
+
+	maze->width = width;
+	maze->height = height;
+	maze->iterations = iterations;
+	maze->Generate(seed);
+	maze->Wait();
+	maze->PlayerReset();
+
+	return true;
+}
+
+bool Replayer::Tick() {
+	if (Finished()) return false;
+
+	while (next < events.size() && events[next].first == tick) {
+		BYTE keys = events[next].second;
+		if (keys & KeyReset) maze->PlayerReset();
+		SetKeyState(maze.get(), keys);
+		next++;
+	}
+
+	maze->PlayerUpdate(1.0 / tickRate);
+	tick++;
+
+	return true;
+}
+
+bool Replayer::Finished() {
+	return tick >= endTick;
+}
+
+bool Replayer::Verify() {
+	return Finished() && maze->StateHash() == expectedHash;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "core.h"
+#include "maze.h"
+
+/*
+Recording layout, little-endian:
+	header: "MZRP", u16 version, u16 tick rate, u32 seed, i32 width, i32 height, i32 iterations, u8 render mode
+	events: varint tick delta, u8 key state (KeyForward | KeyBackward | KeyLeft | KeyRight | KeyReset)
+	end:    varint tick delta, u8 EventEnd, u64 final Maze::StateHash
+A key event holds the key state from its tick onwards, KeyReset runs Maze::PlayerReset before that tick
+*/
+namespace ReplayFormat {
+	const BYTE KeyForward = 0b00000001;
+	const BYTE KeyBackward = 0b00000010;
+	const BYTE KeyLeft = 0b00000100;
+	const BYTE KeyRight = 0b00001000;
+	const BYTE KeyReset = 0b00010000;
+	const BYTE EventEnd = 0xFF;
+
+	const unsigned short Version = 1;
+}
+
+BYTE KeyState(Maze* maze);
+void SetKeyState(Maze* maze, BYTE keys);
+
+// Logs the physics input of a session that starts on a freshly generated maze
+class Recorder {
+public:
+	Recorder(std::shared_ptr<Maze> maze);
+	~Recorder();
+
+	bool Open(const string& path, int renderMode);
+	// Call once per physics tick, before Maze::PlayerUpdate
+	void Tick(bool reset);
+	bool Close();
+	bool Recording();
+private:
+	std::shared_ptr<Maze> maze;
+	// Close may come from the window thread while the physics thread ticks
+	mutex lock;
+	ofstream file;
+
+	unsigned int tick;
+	unsigned int lastEventTick;
+	BYTE lastKeys;
+};
+
+// Drives Maze::PlayerUpdate from a recording with the recorded fixed step
+class Replayer {
+public:
+	Replayer(std::shared_ptr<Maze> maze);
+
+	int tickRate;
+	int renderMode;
+	unsigned long long expectedHash;
+
+	// Loads the recording and regenerates its maze, blocking until generation is done
+	bool Open(const string& path);
+	// Runs one physics tick, returns false once the recording is exhausted
+	bool Tick();
+	bool Finished();
+	bool Verify();
+private:
+	std::shared_ptr<Maze> maze;
+
+	vector<pair<unsigned int, BYTE>> events;
+	size_t next;
+	unsigned int tick;
+	unsigned int endTick;
+};
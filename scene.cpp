@@ -0,0 +1,127 @@
+#include "scene.h"
+
+Scene::Scene() :
+	wallFrequency(10),
+	cameraRange(5),
+	rayStride(8),
+	textureFrequency(-1)
+{}
+
+void Scene::BuildTextures() {
+	wallTexture.resize(TextureSize * TextureSize);
+	exitTexture.resize(TextureSize * TextureSize);
+	floorTexture.resize(TextureSize * TextureSize);
+
+	for (int u = 0; u < TextureSize; u++) {
+		for (int v = 0; v < TextureSize; v++) {
+			int i = u * TextureSize + v;
+
+			bool stripe = wallFrequency > 0 && (u * wallFrequency / TextureSize + v * wallFrequency / TextureSize) % 2;
+			wallTexture[i] = stripe ? 0xFFAAFF00 : 0xFF00FF00;
+			exitTexture[i] = 0xFFFFFFFF;
+			floorTexture[i] = (u == 0 || v == 0) ? 0xFF1A1A1A : 0xFF383838;
+		}
+	}
+
+	textureFrequency = wallFrequency;
+}
+
+int Scene::Render(Maze& maze, const RayTable& rays, int height, double x, double y, double forwardX, double forwardY, vector<uint32_t>& frame) {
+	const int width = rays.columns;
+	frame.resize((size_t)width * height);
+	if (textureFrequency != wallFrequency) BuildTextures();
+
+	const double projection = width / 2.0 / tan(rays.fieldOfView / 2);
+	const double horizon = height / 2.0;
+	const double sideX = -forwardY;
+	const double sideY = forwardX;
+
+	auto fog = [this](double dist) -> uint32_t {
+		return cameraRange > 0 ? (uint32_t)(256 * (1 - min(dist, (double)cameraRange) / cameraRange)) : 0;
+	};
+
+	// One wall slice per column, its texture column and where the rows step through it
+	int raysCast = rays.Cast(maze, x, y, forwardX, forwardY, rayStride, hits);
+	slices.resize(width);
+	for (int j = 0; j < width; j++) {
+		double xComponent = forwardX * rays.xComponent[j] - forwardY * rays.yComponent[j];
+		double yComponent = forwardY * rays.xComponent[j] + forwardX * rays.yComponent[j];
+		const RayHit& hit = hits[j];
+		Slice& slice = slices[j];
+
+		double perpendicular = max(hit.distance * rays.correction[j], 1e-6);
+		double lineHeight = projection / perpendicular;
+		double top = horizon - lineHeight / 2;
+
+		slice.start = (int)max(top, 0.0);
+		slice.end = (int)min(horizon + lineHeight / 2, (double)height);
+
+		double pointX = x + xComponent * hit.distance;
+		double pointY = y + yComponent * hit.distance;
+		const vector<uint32_t>& texture = (pointX >= maze.width - 1) && (pointY >= maze.height - 1) ? exitTexture : wallTexture;
+		slice.texels = &texture[min((int)(hit.wallX * TextureSize), TextureSize - 1) * TextureSize];
+
+		slice.shade = fog(perpendicular);
+		if (hit.side == 1) slice.shade = slice.shade * 3 / 4;
+
+		double step = TextureSize / lineHeight;
+		slice.position = (uint32_t)(int64_t)((slice.start - top) * step * 65536);
+		slice.step = (uint32_t)(int64_t)(step * 65536);
+	}
+
+	/*
+	The frame is filled a row at a time so writes stay sequential. A pixel outside its column's wall
+	slice shows the floor, or the ceiling above the horizon, mirroring the floor row below it: every
+	pixel in a row lies at the same perpendicular distance. Floor texture coordinates are exact every
+	FloorSpan columns and stepped linearly in between, where tangent is close to linear. All texture
+	coordinates are 16.16 fixed point, floor ones relative to the player's cell, and wrap harmlessly
+	at 2^16 texels as the textures repeat every TextureSize
+	*/
+	const double originX = x - floor(x);
+	const double originY = y - floor(y);
+	const int ceilingRows = height - height / 2;
+	for (int i = 0; i < height; i++) {
+		uint32_t* row = &frame[(size_t)i * width];
+		const int floorRow = i < ceilingRows ? height - 1 - i : i;
+
+		double rowDist = 0.5 * projection / max(floorRow + 0.5 - horizon, 0.5);
+		uint32_t rowFog = fog(rowDist);
+		if (i < ceilingRows) rowFog /= 2;
+
+		double baseU = (originX + rowDist * forwardX) * TextureSize * 65536;
+		double baseV = (originY + rowDist * forwardY) * TextureSize * 65536;
+		double sideU = rowDist * sideX * TextureSize * 65536;
+		double sideV = rowDist * sideY * TextureSize * 65536;
+
+		for (int first = 0; first < width; first += FloorSpan) {
+			int last = min(first + FloorSpan, width) - 1;
+			uint32_t u = 0;
+			uint32_t v = 0;
+			uint32_t stepU = 0;
+			uint32_t stepV = 0;
+			// Past the camera range the floor is black, no texture to sample
+			if (rowFog) {
+				double firstU = baseU + sideU * rays.tangent[first];
+				double firstV = baseV + sideV * rays.tangent[first];
+				u = (uint32_t)(int64_t)floor(firstU);
+				v = (uint32_t)(int64_t)floor(firstV);
+				if (last > first) {
+					stepU = (uint32_t)(int32_t)((baseU + sideU * rays.tangent[last] - firstU) / (last - first));
+					stepV = (uint32_t)(int32_t)((baseV + sideV * rays.tangent[last] - firstV) / (last - first));
+				}
+			}
+
+			for (int j = first; j <= last; j++, u += stepU, v += stepV) {
+				Slice& slice = slices[j];
+				if (i >= slice.start && i < slice.end) {
+					row[j] = Shade(slice.texels[slice.position >> 16 & (TextureSize - 1)], slice.shade);
+					slice.position += slice.step;
+				}
+				else if (rowFog) row[j] = Shade(floorTexture[(u >> 16 & (TextureSize - 1)) * TextureSize + (v >> 16 & (TextureSize - 1))], rowFog);
+				else row[j] = 0xFF000000;
+			}
+		}
+	}
+
+	return raysCast;
+}
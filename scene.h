@@ -0,0 +1,56 @@
+#pragma once
+
+#include "core.h"
+#include "maze.h"
+#include "raytable.h"
+
+// Scales the channels of an opaque BGRA pixel by factor / 256
+inline uint32_t Shade(uint32_t color, uint32_t factor) {
+	return 0xFF000000 | ((((color & 0xFF00FF) * factor) >> 8) & 0xFF00FF) | ((((color & 0x00FF00) * factor) >> 8) & 0x00FF00);
+}
+
+/*
+Software renderer for the first-person view of mode 2, into a BGRA framebuffer the caller uploads.
+Textures are TextureSize x TextureSize and stored column-major, so a wall slice samples one
+contiguous column
+*/
+class Scene {
+public:
+	Scene();
+
+	// Stripes across the wall texture, 0 for plain walls
+	int wallFrequency;
+	// Walls, floor and ceiling fade to black over this many cells
+	int cameraRange;
+	// Passed to RayTable::Cast, 1 casts a ray per column
+	int rayStride;
+
+	/*
+	Draws the view from x, y facing forwardX, forwardY into frame as rays.columns x height pixels,
+	row by row, and returns the number of rays cast
+	*/
+	int Render(Maze& maze, const RayTable& rays, int height, double x, double y, double forwardX, double forwardY, vector<uint32_t>& frame);
+
+	static const int TextureSize = 64;
+	// Columns between exactly computed floor texture coordinates
+	static const int FloorSpan = 16;
+private:
+	vector<uint32_t> wallTexture;
+	vector<uint32_t> exitTexture;
+	vector<uint32_t> floorTexture;
+	int textureFrequency;
+	vector<RayHit> hits;
+
+	// Rows [start, end) of a column show its wall, sampling texels at 16.16 fixed point position
+	struct Slice {
+		int start;
+		int end;
+		const uint32_t* texels;
+		uint32_t shade;
+		uint32_t position;
+		uint32_t step;
+	};
+	vector<Slice> slices;
+
+	void BuildTextures();
+};
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "core.h"
+
+/*
+Bounded lock-free queue between exactly one producer thread and one consumer thread.
+Push fails when the queue is full and Pop when it is empty, neither ever blocks
+*/
+template <typename T, size_t Capacity>
+class SpscQueue {
+	static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "SpscQueue capacity must be a power of two");
+public:
+	SpscQueue() : head(0), tail(0) {}
+
+	// Producer only
+	bool Push(const T& item) {
+		size_t t = tail.load(memory_order_relaxed);
+		if (t - head.load(memory_order_acquire) == Capacity) return false;
+
+		items[t & (Capacity - 1)] = item;
+		tail.store(t + 1, memory_order_release);
+		return true;
+	}
+
+	// Consumer only
+	bool Pop(T& item) {
+		size_t h = head.load(memory_order_relaxed);
+		if (h == tail.load(memory_order_acquire)) return false;
+
+		item = items[h & (Capacity - 1)];
+		head.store(h + 1, memory_order_release);
+		return true;
+	}
+private:
+	// Each index is written by one side only, keep them on separate cache lines
+	alignas(64) atomic<size_t> head;
+	alignas(64) atomic<size_t> tail;
+	T items[Capacity];
+};
@@ -0,0 +1,544 @@
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "ws2_32.lib")
+#else
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+// Socket headers first, like framework.h's Windows headers they have to come before using namespace std
+#include "stream.h"
+#include "replay.h"
+
+using namespace StreamFormat;
+
+static void WriteValue(vector<BYTE>& out, unsigned long long value, size_t size) {
+	for (size_t i = 0; i < size; i++) out.push_back((BYTE)(value >> (8 * i)));
+}
+
+static void WriteVarint(vector<BYTE>& out, unsigned long long value) {
+	while (value >= 0x80) {
+		out.push_back((BYTE)(value | 0x80));
+		value >>= 7;
+	}
+	out.push_back((BYTE)value);
+}
+
+static void WriteSigned(vector<BYTE>& out, long long value) {
+	WriteVarint(out, ((unsigned long long)value << 1) ^ (unsigned long long)(value >> 63));
+}
+
+static void WriteMessage(vector<BYTE>& out, BYTE type, const vector<BYTE>& payload) {
+	out.push_back(type);
+	WriteVarint(out, payload.size());
+	out.insert(out.end(), payload.begin(), payload.end());
+}
+
+// Bounds-checked reads from a received payload, every read fails once the data runs out
+struct Reader {
+	const BYTE* data;
+	size_t size;
+	size_t position;
+
+	bool Value(unsigned long long& value, size_t bytes) {
+		if (size - position < bytes) return false;
+		value = 0;
+		for (size_t i = 0; i < bytes; i++) value |= (unsigned long long)data[position++] << (8 * i);
+		return true;
+	}
+
+	bool Varint(unsigned long long& value) {
+		value = 0;
+		for (int shift = 0; shift < 64 && position < size; shift += 7) {
+			BYTE c = data[position++];
+			value |= (unsigned long long)(c & 0x7F) << shift;
+			if (!(c & 0x80)) return true;
+		}
+		return false;
+	}
+
+	bool Signed(long long& value) {
+		unsigned long long raw;
+		if (!Varint(raw)) return false;
+		value = (long long)(raw >> 1) ^ -(long long)(raw & 1);
+		return true;
+	}
+};
+
+static int QuantizeAngle(double direction) {
+	return (int)(llround(direction / (2 * PI) * AngleScale) & (AngleScale - 1));
+}
+
+StreamEncoder::StreamEncoder() :
+	snapshots(0),
+	snapshotBytes(0),
+	deltas(0),
+	deltaBytes(0),
+	valid(false),
+	revision(0),
+	scan(0),
+	tick(0),
+	seed(0),
+	width(0),
+	height(0),
+	iterations(0),
+	x(0),
+	y(0),
+	direction(0),
+	keys(0)
+{}
+
+// Collects the cells in [begin, end) that differ from the shadow into changes and updates the shadow
+void StreamEncoder::Diff(const BYTE* board, size_t begin, size_t end) {
+	size_t i = begin;
+	for (; i + 8 <= end; i += 8) {
+		uint64_t current;
+		uint64_t previous;
+		memcpy(&current, board + i, 8);
+		memcpy(&previous, &shadow[i], 8);
+		if (current == previous) continue;
+
+		for (size_t k = i; k < i + 8; k++) {
+			if ((board[k] ^ shadow[k]) & CellMask) changes.push_back((unsigned int)k);
+		}
+		memcpy(&shadow[i], &current, 8);
+	}
+	for (; i < end; i++) {
+		if ((board[i] ^ shadow[i]) & CellMask) changes.push_back((unsigned int)i);
+		shadow[i] = board[i];
+	}
+}
+
+void StreamEncoder::Encode(Maze& maze, unsigned int tick_, vector<BYTE>& out) {
+	// A board that is still being carved changes everywhere, wait for the finished one
+	const BYTE* board = maze.GetBoard();
+	if (!maze.generated || !board) return;
+
+	const size_t cells = (size_t)maze.width * maze.height;
+	bool snapshot = !valid || maze.width != width || maze.height != height;
+
+	changes.clear();
+	if (snapshot) shadow.assign(board, board + cells);
+	else if (maze.revision != revision || cells <= ScanCells) Diff(board, 0, cells);
+	else {
+		// The window starts on a word boundary and wraps round the end of the board
+		size_t end = scan + ScanCells;
+		Diff(board, scan, min(end, cells));
+		if (end > cells) {
+			Diff(board, 0, end - cells);
+			sort(changes.begin(), changes.end());
+		}
+		scan = end % cells / 8 * 8;
+	}
+
+	// Two bytes or more per changed cell, past a quarter byte per cell a snapshot is smaller
+	if (changes.size() * 2 > cells / 4) snapshot = true;
+	revision = maze.revision;
+
+	long long newX = llround(maze.player.x * PositionScale);
+	long long newY = llround(maze.player.y * PositionScale);
+	int newDirection = QuantizeAngle(maze.player.direction);
+	BYTE newKeys = KeyState(&maze);
+
+	if (!snapshot && changes.empty() && newX == x && newY == y && newDirection == direction && newKeys == keys) return;
+
+	payload.clear();
+	if (!snapshot) {
+		// The turn taken the short way round
+		int turn = ((newDirection - direction + AngleScale / 2) & (AngleScale - 1)) - AngleScale / 2;
+
+		WriteVarint(payload, tick_ - tick);
+		WriteSigned(payload, newX - x);
+		WriteSigned(payload, newY - y);
+		WriteSigned(payload, turn);
+		payload.push_back(newKeys);
+
+		WriteVarint(payload, changes.size());
+		long long last = -1;
+		for (unsigned int cell : changes) {
+			WriteVarint(payload, cell - last);
+			payload.push_back(shadow[cell] & CellMask);
+			last = cell;
+		}
+	}
+
+	tick = tick_;
+	seed = maze.seed;
+	width = maze.width;
+	height = maze.height;
+	iterations = maze.iterations;
+	x = newX;
+	y = newY;
+	direction = newDirection;
+	keys = newKeys;
+	valid = true;
+
+	size_t before = out.size();
+	if (snapshot) {
+		Snapshot(out);
+		snapshots++;
+		snapshotBytes += out.size() - before;
+	}
+	else {
+		WriteMessage(out, MessageDelta, payload);
+		deltas++;
+		deltaBytes += out.size() - before;
+	}
+}
+
+bool StreamEncoder::Snapshot(vector<BYTE>& out) {
+	if (!valid) return false;
+
+	payload.clear();
+	WriteValue(payload, Version, 2);
+	WriteValue(payload, tick, 4);
+	WriteValue(payload, seed, 4);
+	WriteValue(payload, (unsigned int)width, 4);
+	WriteValue(payload, (unsigned int)height, 4);
+	WriteValue(payload, (unsigned int)iterations, 4);
+	WriteSigned(payload, x);
+	WriteSigned(payload, y);
+	WriteVarint(payload, direction);
+	payload.push_back(keys);
+
+	const size_t cells = (size_t)width * height;
+	size_t start = payload.size();
+	payload.resize(start + (cells + 3) / 4);
+	for (size_t i = 0; i < cells; i++) payload[start + i / 4] |= (shadow[i] & CellMask) << (2 * (i % 4));
+
+	WriteMessage(out, MessageSnapshot, payload);
+	return true;
+}
+
+StreamDecoder::StreamDecoder() :
+	valid(false),
+	tick(0),
+	seed(0),
+	width(0),
+	height(0),
+	iterations(0),
+	playerX(0),
+	playerY(0),
+	playerDirection(0),
+	keys(0),
+	x(0),
+	y(0),
+	direction(0)
+{}
+
+bool StreamDecoder::Feed(vector<BYTE>& data) {
+	size_t offset = 0;
+	bool intact = true;
+
+	while (offset < data.size()) {
+		Reader header = { data.data(), data.size(), offset + 1 };
+		unsigned long long length;
+		if (!header.Varint(length)) {
+			// A length varint cut off by the end of the data is still arriving, a longer one is garbage
+			intact = data.size() - offset < 11;
+			break;
+		}
+		if (data.size() - header.position < length) break;
+
+		if (!Apply(data[offset], data.data() + header.position, (size_t)length)) {
+			intact = false;
+			break;
+		}
+		offset = header.position + (size_t)length;
+	}
+
+	data.erase(data.begin(), data.begin() + offset);
+	return intact;
+}
+
+bool StreamDecoder::Apply(BYTE type, const BYTE* payload, size_t length) {
+	Reader reader = { payload, length, 0 };
+	unsigned long long value;
+	long long dX;
+	long long dY;
+	long long turn;
+
+	if (type == MessageSnapshot) {
+		unsigned long long version;
+		unsigned long long fields[5];
+		if (!reader.Value(version, 2) || version != Version) return false;
+		for (unsigned long long& field : fields) {
+			if (!reader.Value(field, 4)) return false;
+		}
+		if (!reader.Signed(x) || !reader.Signed(y) || !reader.Varint(value) || reader.position >= length) return false;
+
+		int w = (int)fields[2];
+		int h = (int)fields[3];
+		if (w < 1 || h < 1 || length - reader.position - 1 != ((size_t)w * h + 3) / 4) return false;
+
+		tick = (unsigned int)fields[0];
+		seed = (unsigned int)fields[1];
+		width = w;
+		height = h;
+		iterations = (int)fields[4];
+		direction = (int)(value & (AngleScale - 1));
+		keys = payload[reader.position++];
+
+		board.resize((size_t)width * height);
+		for (size_t i = 0; i < board.size(); i++) board[i] = (payload[reader.position + i / 4] >> (2 * (i % 4))) & CellMask;
+		valid = true;
+	}
+	else if (type == MessageDelta) {
+		if (!valid || !reader.Varint(value) || !reader.Signed(dX) || !reader.Signed(dY) || !reader.Signed(turn) || reader.position >= length) return false;
+		tick += (unsigned int)value;
+		x += dX;
+		y += dY;
+		direction = (int)((direction + turn) & (AngleScale - 1));
+		keys = payload[reader.position++];
+
+		unsigned long long count;
+		if (!reader.Varint(count)) return false;
+		long long cell = -1;
+		for (unsigned long long i = 0; i < count; i++) {
+			if (!reader.Varint(value) || reader.position >= length || value == 0 || value >= board.size() - cell) return false;
+			cell += (long long)value;
+			board[(size_t)cell] = payload[reader.position++] & CellMask;
+		}
+	}
+	// Unknown message types are skipped, newer servers may send more than this client knows
+
+	playerX = x / PositionScale;
+	playerY = y / PositionScale;
+	playerDirection = direction * 2 * PI / AngleScale;
+	return true;
+}
+
+/*
+The few socket calls that differ between Winsock and POSIX. Handles are kept as intptr_t, which
+holds both a SOCKET and a file descriptor
+*/
+#ifdef _WIN32
+typedef SOCKET Handle;
+static const intptr_t NoSocket = (intptr_t)INVALID_SOCKET;
+
+static bool SocketsReady() {
+	static bool ready = [] {
+		WSADATA data;
+		return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+	}();
+	return ready;
+}
+
+static void CloseSocket(intptr_t s) {
+	closesocket((Handle)s);
+}
+
+static bool SetNonBlocking(intptr_t s) {
+	u_long on = 1;
+	return ioctlsocket((Handle)s, FIONBIO, &on) == 0;
+}
+
+static bool WouldBlock() {
+	return WSAGetLastError() == WSAEWOULDBLOCK;
+}
+
+static long long SendSome(intptr_t s, const BYTE* data, size_t size) {
+	return send((Handle)s, (const char*)data, (int)min(size, (size_t)INT_MAX), 0);
+}
+
+static long long ReceiveSome(intptr_t s, BYTE* data, size_t size) {
+	return recv((Handle)s, (char*)data, (int)min(size, (size_t)INT_MAX), 0);
+}
+#else
+typedef int Handle;
+static const intptr_t NoSocket = -1;
+
+static bool SocketsReady() {
+	return true;
+}
+
+static void CloseSocket(intptr_t s) {
+	close((Handle)s);
+}
+
+static bool SetNonBlocking(intptr_t s) {
+	int flags = fcntl((Handle)s, F_GETFL, 0);
+	return flags >= 0 && fcntl((Handle)s, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+static bool WouldBlock() {
+	return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+}
+
+static long long SendSome(intptr_t s, const BYTE* data, size_t size) {
+	// A client that hung up must not take the process down with SIGPIPE
+#ifdef MSG_NOSIGNAL
+	return send((Handle)s, data, size, MSG_NOSIGNAL);
+#else
+	int on = 1;
+	setsockopt((Handle)s, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+	return send((Handle)s, data, size, 0);
+#endif
+}
+
+static long long ReceiveSome(intptr_t s, BYTE* data, size_t size) {
+	return recv((Handle)s, data, size, 0);
+}
+#endif
+
+static sockaddr_in Loopback(const string& host, int port) {
+	sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_port = htons((unsigned short)port);
+	if (host.empty() || inet_pton(AF_INET, host.c_str(), &address.sin_addr) != 1) address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	return address;
+}
+
+StreamServer::StreamServer() :
+	port(0),
+	encodeTime(0),
+	listener(NoSocket)
+{}
+
+StreamServer::~StreamServer() {
+	Close();
+}
+
+bool StreamServer::Open(int port_) {
+	Close();
+	if (!SocketsReady()) return false;
+
+	intptr_t s = (intptr_t)::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (s == NoSocket) return false;
+
+	int on = 1;
+	setsockopt((Handle)s, SOL_SOCKET, SO_REUSEADDR, (const char*)&on, sizeof(on));
+
+	sockaddr_in address = Loopback("", port_);
+	socklen_t size = sizeof(address);
+	if (::bind((Handle)s, (sockaddr*)&address, sizeof(address)) != 0 || listen((Handle)s, 16) != 0 || !SetNonBlocking(s)
+		|| getsockname((Handle)s, (sockaddr*)&address, &size) != 0) {
+		CloseSocket(s);
+		return false;
+	}
+
+	listener = s;
+	port = ntohs(address.sin_port);
+	return true;
+}
+
+void StreamServer::Close() {
+	for (Client& client : clients) CloseSocket(client.connection);
+	clients.clear();
+
+	if (listener != NoSocket) CloseSocket(listener);
+	listener = NoSocket;
+}
+
+void StreamServer::Publish(Maze& maze, unsigned int tick) {
+	if (listener == NoSocket) return;
+
+	// A client joining now starts from the state the last message left the others in
+	for (;;) {
+		intptr_t accepted = (intptr_t)accept((Handle)listener, NULL, NULL);
+		if (accepted == NoSocket) break;
+
+		int on = 1;
+		setsockopt((Handle)accepted, IPPROTO_TCP, TCP_NODELAY, (const char*)&on, sizeof(on));
+		if (!SetNonBlocking(accepted)) {
+			CloseSocket(accepted);
+			continue;
+		}
+
+		Client client;
+		client.connection = accepted;
+		encoder.Snapshot(client.pending);
+		clients.push_back(move(client));
+	}
+
+	message.clear();
+	auto t1 = chrono::steady_clock::now();
+	encoder.Encode(maze, tick, message);
+	encodeTime += chrono::duration<double>(chrono::steady_clock::now() - t1).count();
+
+	for (size_t i = 0; i < clients.size();) {
+		Client& client = clients[i];
+		client.pending.insert(client.pending.end(), message.begin(), message.end());
+
+		if (Flush(client) && client.pending.size() <= MaxPending) i++;
+		else {
+			CloseSocket(client.connection);
+			clients.erase(clients.begin() + i);
+		}
+	}
+}
+
+int StreamServer::Clients() {
+	return (int)clients.size();
+}
+
+bool StreamServer::Flush(Client& client) {
+	size_t sent = 0;
+	while (sent < client.pending.size()) {
+		long long result = SendSome(client.connection, client.pending.data() + sent, client.pending.size() - sent);
+		if (result > 0) sent += (size_t)result;
+		else if (result < 0 && WouldBlock()) break;
+		else return false;
+	}
+
+	client.pending.erase(client.pending.begin(), client.pending.begin() + sent);
+	return true;
+}
+
+StreamClient::StreamClient() :
+	bytesReceived(0),
+	connection(NoSocket)
+{}
+
+StreamClient::~StreamClient() {
+	Close();
+}
+
+bool StreamClient::Connect(const string& host, int port) {
+	Close();
+	if (!SocketsReady()) return false;
+
+	intptr_t s = (intptr_t)::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (s == NoSocket) return false;
+
+	sockaddr_in address = Loopback(host, port);
+	if (::connect((Handle)s, (sockaddr*)&address, sizeof(address)) != 0 || !SetNonBlocking(s)) {
+		CloseSocket(s);
+		return false;
+	}
+
+	connection = s;
+	return true;
+}
+
+void StreamClient::Close() {
+	if (connection != NoSocket) CloseSocket(connection);
+	connection = NoSocket;
+}
+
+bool StreamClient::Poll() {
+	if (connection == NoSocket) return false;
+
+	BYTE buffer[1 << 16];
+	bool open = true;
+	for (;;) {
+		long long result = ReceiveSome(connection, buffer, sizeof(buffer));
+		if (result > 0) {
+			received.insert(received.end(), buffer, buffer + result);
+			bytesReceived += result;
+		}
+		else {
+			open = result < 0 && WouldBlock();
+			break;
+		}
+	}
+
+	return state.Feed(received) && open;
+}
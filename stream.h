@@ -0,0 +1,149 @@
+#pragma once
+
+#include "core.h"
+#include "maze.h"
+
+/*
+Spectator stream, a sequence of messages: u8 type, varint payload length, payload. Integers are
+little-endian, signed varints are zigzag encoded
+	snapshot: u16 version, u32 tick, u32 seed, i32 width, i32 height, i32 iterations,
+	          signed varint x and y, varint direction, u8 keys,
+	          cells, 2 bits each (PathMask | TruePathMask), 4 to a byte starting with the low bits
+	delta:    varint tick delta, signed varint x, y and direction deltas, u8 keys,
+	          varint changed cells, each as varint index delta and u8 cell
+Keys hold the ReplayFormat key bits. Positions are in 1/PositionScale cells and directions in 1/AngleScale turns. Deltas are against
+the previous message, cell index deltas against the previous changed cell (the first one against -1)
+*/
+namespace StreamFormat {
+	const BYTE MessageSnapshot = 1;
+	const BYTE MessageDelta = 2;
+	const BYTE CellMask = Maze::PathMask | Maze::TruePathMask;
+
+	const double PositionScale = 4096;
+	const int AngleScale = 65536;
+
+	const unsigned short Version = 1;
+}
+
+/*
+Turns a maze into stream messages once per tick. Keeps a shadow copy of what it last sent and diffs
+the board against it a word at a time: all of it when the maze revision changed, otherwise the next
+ScanCells cells round the board, so single cell edits cost a bounded amount per tick and show up
+within cells / ScanCells ticks. A tick in which nothing changed emits nothing
+*/
+class StreamEncoder {
+public:
+	StreamEncoder();
+
+	// Appends this tick's message to out, a snapshot when the board changed size or most of its cells
+	void Encode(Maze& maze, unsigned int tick, vector<BYTE>& out);
+	// Appends a snapshot of the last encoded state, for a client joining between messages
+	bool Snapshot(vector<BYTE>& out);
+
+	long long snapshots;
+	long long snapshotBytes;
+	long long deltas;
+	long long deltaBytes;
+
+	static const size_t ScanCells = 1 << 16;
+private:
+	bool valid;
+	unsigned int revision;
+	size_t scan;
+	unsigned int tick;
+	unsigned int seed;
+	int width;
+	int height;
+	int iterations;
+	long long x;
+	long long y;
+	int direction;
+	BYTE keys;
+	vector<BYTE> shadow;
+	vector<unsigned int> changes;
+	vector<BYTE> payload;
+
+	void Diff(const BYTE* board, size_t begin, size_t end);
+};
+
+// Rebuilds the streamed state on the receiving side
+class StreamDecoder {
+public:
+	StreamDecoder();
+
+	bool valid;
+	unsigned int tick;
+	unsigned int seed;
+	int width;
+	int height;
+	int iterations;
+	double playerX;
+	double playerY;
+	double playerDirection;
+	BYTE keys;
+	// One byte per cell holding only the CellMask bits
+	vector<BYTE> board;
+
+	// Applies and removes every complete message at the front of data, false if one is malformed
+	bool Feed(vector<BYTE>& data);
+private:
+	long long x;
+	long long y;
+	int direction;
+
+	bool Apply(BYTE type, const BYTE* payload, size_t length);
+};
+
+/*
+Serves one maze to any number of clients over TCP on 127.0.0.1. Every tick is encoded once and the
+same bytes queued to each client, a new client first gets a snapshot. Sockets never block, a client
+that falls more than MaxPending bytes behind is dropped
+*/
+class StreamServer {
+public:
+	StreamServer();
+	~StreamServer();
+
+	// Port 0 picks a free one, port holds the one in use afterwards
+	bool Open(int port);
+	void Close();
+	// Call from the thread that replaces the board, after the ticks it describes
+	void Publish(Maze& maze, unsigned int tick);
+	int Clients();
+
+	int port;
+	StreamEncoder encoder;
+	// Seconds spent encoding, without accepting or sending
+	double encodeTime;
+
+	static const size_t MaxPending = 1 << 22;
+private:
+	struct Client {
+		intptr_t connection;
+		vector<BYTE> pending;
+	};
+
+	intptr_t listener;
+	vector<Client> clients;
+	vector<BYTE> message;
+
+	// Sends what the socket takes right away, false once the client is gone
+	bool Flush(Client& client);
+};
+
+class StreamClient {
+public:
+	StreamClient();
+	~StreamClient();
+
+	bool Connect(const string& host, int port);
+	void Close();
+	// Applies whatever has arrived without waiting, false once the stream is closed or broken
+	bool Poll();
+
+	StreamDecoder state;
+	long long bytesReceived;
+private:
+	intptr_t connection;
+	vector<BYTE> received;
+};
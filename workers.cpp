@@ -0,0 +1,74 @@
+#include "workers.h"
+
+WorkerPool::WorkerPool() :
+	job(nullptr),
+	jobCount(0),
+	chunk(0),
+	generation(0),
+	remaining(0),
+	stopping(false)
+{}
+
+WorkerPool::~WorkerPool() {
+	Resize(0);
+}
+
+void WorkerPool::Run(size_t count, int threads, const Job& body) {
+	size_t slices = (size_t)max(threads, 1);
+	if (slices == 1 || count < 2) {
+		body(0, 0, count);
+		return;
+	}
+	if (workers.size() != slices - 1) Resize(slices - 1);
+
+	{
+		lock_guard<mutex> guard(lock);
+		job = &body;
+		jobCount = count;
+		chunk = (count + slices - 1) / slices;
+		remaining = workers.size();
+		generation++;
+	}
+	wake.notify_all();
+
+	body(0, 0, min(count, chunk));
+
+	unique_lock<mutex> guard(lock);
+	done.wait(guard, [this] { return remaining == 0; });
+}
+
+void WorkerPool::Resize(size_t count) {
+	{
+		lock_guard<mutex> guard(lock);
+		stopping = true;
+	}
+	wake.notify_all();
+	for (thread& worker : workers) worker.join();
+	workers.clear();
+
+	stopping = false;
+	for (size_t i = 0; i < count; i++) workers.push_back(thread(&WorkerPool::Work, this, i + 1, generation));
+}
+
+void WorkerPool::Work(size_t index, unsigned long long seen) {
+	for (;;) {
+		const Job* body;
+		size_t begin;
+		size_t end;
+		{
+			unique_lock<mutex> guard(lock);
+			wake.wait(guard, [&] { return stopping || generation != seen; });
+			if (stopping) return;
+
+			seen = generation;
+			body = job;
+			begin = min(jobCount, index * chunk);
+			end = min(jobCount, begin + chunk);
+		}
+
+		if (begin < end) (*body)(index, begin, end);
+
+		lock_guard<mutex> guard(lock);
+		if (--remaining == 0) done.notify_one();
+	}
+}
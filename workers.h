@@ -0,0 +1,36 @@
+#pragma once
+
+#include "core.h"
+#include <condition_variable>
+#include <functional>
+
+/*
+Threads that stay alive between jobs, for work that is split up many times a second. Run cuts
+[0, count) into one slice per thread, works the first slice on the calling thread and returns
+once every slice is done, so each call is one fork and one barrier without creating threads
+*/
+class WorkerPool {
+public:
+	typedef function<void(size_t worker, size_t begin, size_t end)> Job;
+
+	WorkerPool();
+	~WorkerPool();
+
+	// threads counts the caller, a change restarts the pool. Slices past count come out empty
+	void Run(size_t count, int threads, const Job& body);
+private:
+	vector<thread> workers;
+	mutex lock;
+	condition_variable wake;
+	condition_variable done;
+
+	const Job* job;
+	size_t jobCount;
+	size_t chunk;
+	unsigned long long generation;
+	size_t remaining;
+	bool stopping;
+
+	void Resize(size_t count);
+	void Work(size_t index, unsigned long long seen);
+};